@@ -0,0 +1,55 @@
+#pragma once
+
+#include <concepts>
+
+#include "base.h"
+
+// Asynchronous memory access chaining: WIDTH lookups are kept in flight, each one a small state
+// machine. Every step looks at the line the previous step prefetched and either finishes or
+// prefetches the next line it needs, then moves on to the next lookup. Unlike find_batch(), a
+// key that needs a second line (a chain, a long probe, the other bucket) only delays itself.
+//
+// A table opts in by providing
+//   struct Probe;                           the state of one lookup, with a value member
+//   void probe_start(Probe&, uint64_t key)  hash and prefetch the first line
+//   bool probe_step(Probe&)                 true once the value has been found
+// Tables without them fall back to find_batch(). Assumes every key is in the map.
+template<typename Map>
+concept Probing = requires(Map map, typename Map::Probe probe, uint64_t key) {
+    { map.probe_start(probe, key) } -> std::same_as<void>;
+    { map.probe_step(probe) } -> std::same_as<bool>;
+};
+
+template<uint64_t WIDTH, typename Map>
+void find_amac(Map& map, const uint64_t* keys, size_t n, uint64_t* out) {
+    if constexpr(Probing<Map>) {
+        typename Map::Probe probes[WIDTH];
+        size_t outputs[WIDTH];
+        size_t next = 0, active = 0;
+        for(; active < WIDTH && next < n; active++, next++) {
+            map.probe_start(probes[active], keys[next]);
+            outputs[active] = next;
+        }
+        while(active) {
+            for(size_t i = 0; i < active;) {
+                if(!map.probe_step(probes[i])) {
+                    i++;
+                } else {
+                    out[outputs[i]] = probes[i].value;
+                    if(next < n) {
+                        map.probe_start(probes[i], keys[next]);
+                        outputs[i] = next++;
+                        i++;
+                    } else {
+                        // the last lookup hasn't had its turn this round yet, so it takes this one
+                        active--;
+                        probes[i] = probes[active];
+                        outputs[i] = outputs[active];
+                    }
+                }
+            }
+        }
+    } else {
+        map.find_batch(keys, n, out);
+    }
+}
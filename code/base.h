@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <string_view>
 
 #define CACHE_LINE 64
 
@@ -19,10 +21,21 @@ inline void* __aligned_alloc(size_t alignment, size_t size) {
     return _aligned_malloc(size, alignment);
 }
 inline void __aligned_free(void* ptr) { return _aligned_free(ptr); }
+inline int __ctz(int32_t x) {
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+}
+inline int __ctz64(uint64_t x) {
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return index;
+}
 #else
 #include <csignal>
 #include <cstdlib>
 #include <immintrin.h>
+#include <sys/mman.h>
 inline void prefetch(const void* ptr) { __builtin_prefetch(ptr, 0, 0); }
 inline void assert(bool val) {
     if(!val) {
@@ -32,10 +45,84 @@ inline void assert(bool val) {
     }
 }
 inline void* __aligned_alloc(size_t alignment, size_t size) {
-    return std::aligned_alloc(alignment, size);
+    // aligned_alloc requires the size to be a multiple of the alignment
+    return std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
 }
 inline void __aligned_free(void* ptr) { return std::free(ptr); }
+inline int __ctz(int32_t x) { return __builtin_ctz(x); }
+inline int __ctz64(uint64_t x) { return __builtin_ctzll(x); }
+#endif
+
+// A table's erase() halves its capacity once fewer than min_load of its slots are full, and
+// min_load starts out at SHRINK_LOAD times the load factor. A table just halved is then under
+// half its load factor, so it needs as many inserts to grow back as erases to shrink again.
+constexpr double SHRINK_LOAD = 0.25;
+
+// The smallest power-of-two capacity of at least min that holds n keys at under load keys per
+// slot, or per bucket for the bucketed tables. shrink_to_fit() shrinks to it and reserve()
+// grows to it.
+inline uint64_t capacity_for(uint64_t n, double load, uint64_t min = 8) {
+    uint64_t capacity = min;
+    while(n >= capacity * load) capacity *= 2;
+    return capacity;
+}
+
+// Allocation policies for the slot arrays. Both return CACHE_LINE-aligned memory and need the
+// size again when freeing.
+struct Aligned_Alloc {
+    static void* alloc(size_t size) { return __aligned_alloc(CACHE_LINE, size); }
+    static void free(void* ptr, size_t) { __aligned_free(ptr); }
+};
+
+// Backs arrays of at least one huge page with 2 MiB pages: reserved hugetlbfs pages if there
+// are any, otherwise a 2 MiB-aligned mapping marked for transparent huge pages. POPULATE
+// faults everything in up front, so grow() pays for it instead of the first accesses.
+// Smaller arrays, and everything on Windows, fall back to Aligned_Alloc.
+template<bool POPULATE = false>
+struct Huge_Alloc {
+
+    static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+    static size_t round(size_t size) { return (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1); }
+
+#ifdef _WIN32
+    static void* alloc(size_t size) { return Aligned_Alloc::alloc(size); }
+    static void free(void* ptr, size_t size) { Aligned_Alloc::free(ptr, size); }
+#else
+    static void* alloc(size_t size) {
+        if(size < HUGE_PAGE) return Aligned_Alloc::alloc(size);
+        size = round(size);
+        constexpr int PROT = PROT_READ | PROT_WRITE;
+        constexpr int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_HUGETLB
+        void* huge = mmap(nullptr, size, PROT, FLAGS | MAP_HUGETLB | (POPULATE ? MAP_POPULATE : 0),
+                          -1, 0);
+        if(huge != MAP_FAILED) return huge;
+#endif
+        // over-map by a page so the start can be moved up to a huge page boundary
+        char* base = reinterpret_cast<char*>(mmap(nullptr, size + HUGE_PAGE, PROT, FLAGS, -1, 0));
+        assert(base != MAP_FAILED);
+        char* ptr = reinterpret_cast<char*>(
+            (reinterpret_cast<uintptr_t>(base) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+        if(ptr > base) munmap(base, ptr - base);
+        munmap(ptr + size, base + HUGE_PAGE - ptr);
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+        // populate after madvise so the faults already get huge pages
+        if constexpr(POPULATE) {
+            for(size_t i = 0; i < size; i += 4096) ptr[i] = 0;
+        }
+        return ptr;
+    }
+    static void free(void* ptr, size_t size) {
+        if(size < HUGE_PAGE)
+            Aligned_Alloc::free(ptr, size);
+        else
+            munmap(ptr, round(size));
+    }
 #endif
+};
 
 // These constants are all large primes
 
@@ -51,3 +138,109 @@ inline uint64_t squirrel3(uint64_t at) {
     at ^= (at >> 8);
     return at;
 }
+
+// Hash policies. Tables take one as their Hash parameter and call Hash{}(key); like std::hash
+// they also work as the hasher of std::unordered_map. Several tables take a second index from
+// the high 32 bits, so every policy except Identity_Hash fills all 64.
+
+struct Squirrel3_Hash {
+    uint64_t operator()(uint64_t key) const { return squirrel3(key); }
+};
+
+// a single multiply, as FxHash does for one word; the low bits only depend on the low bits of
+// the key, so keys that differ only in their high bits all collide
+struct Fx_Hash {
+    uint64_t operator()(uint64_t key) const { return key * 0x517CC1B727220A95ULL; }
+};
+
+// the MurmurHash3 finalizer
+struct Fmix64_Hash {
+    uint64_t operator()(uint64_t key) const {
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDULL;
+        key ^= key >> 33;
+        key *= 0xC4CEB9FE1A85EC53ULL;
+        key ^= key >> 33;
+        return key;
+    }
+};
+
+// wyhash's mum mix: a 64x64->128 multiply with both halves folded together
+struct Wy_Hash {
+    uint64_t operator()(uint64_t key) const {
+        uint64_t a = key ^ 0xA0761D6478BD642FULL, b = 0xE7037ED1A0B428DBULL;
+#ifdef _WIN32
+        uint64_t hi;
+        uint64_t lo = _umul128(a, b, &hi);
+#else
+        unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+        uint64_t lo = static_cast<uint64_t>(r), hi = static_cast<uint64_t>(r >> 64);
+#endif
+        return lo ^ hi;
+    }
+};
+
+// two hardware CRC32s with different seeds, since one only gives 32 bits
+struct Crc32_Hash {
+    uint64_t operator()(uint64_t key) const {
+        uint64_t lo = _mm_crc32_u64(0, key);
+        uint64_t hi = _mm_crc32_u64(0x9E3779B9, key);
+        return hi << 32 | lo;
+    }
+};
+
+// only usable with tables that index from the low bits
+struct Identity_Hash {
+    uint64_t operator()(uint64_t key) const { return key; }
+};
+
+// Wider keys, for the tables that take a key type. A UUID-sized key hashes its halves one
+// after the other; strings go through the mum mix eight bytes at a time.
+
+struct Key128 {
+    uint64_t lo, hi;
+    bool operator==(const Key128&) const = default;
+};
+
+struct Key128_Hash {
+    uint64_t operator()(const Key128& key) const { return squirrel3(squirrel3(key.lo) ^ key.hi); }
+};
+
+struct String_Hash {
+    uint64_t operator()(std::string_view key) const {
+        uint64_t hash = key.size();
+        size_t i = 0;
+        for(; i + 8 <= key.size(); i += 8) {
+            uint64_t word;
+            std::memcpy(&word, key.data() + i, 8);
+            hash = Wy_Hash{}(hash ^ word);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, key.data() + i, key.size() - i);
+        return Wy_Hash{}(hash ^ tail);
+    }
+};
+
+// Batched lookups, software pipelined: the key WINDOW places ahead is prefetched before each
+// lookup, so up to WINDOW keys' cache misses are in flight at once. Tables pick WINDOW by how
+// many lines their prefetch() touches. find_batch assumes every key is in the map.
+template<uint64_t WINDOW, typename Map, typename K, typename V>
+void find_batch(Map& map, const K* keys, size_t n, V* out) {
+    static_assert((WINDOW & (WINDOW - 1)) == 0);
+    uint64_t prefetched[WINDOW];
+    for(size_t i = 0; i < std::min<size_t>(n, WINDOW); i++) prefetched[i] = map.prefetch(keys[i]);
+    for(size_t i = 0; i < n; i++) {
+        uint64_t steps = 0;
+        out[i] = map.find_indexed(keys[i], prefetched[i & (WINDOW - 1)], &steps);
+        if(i + WINDOW < n) prefetched[i & (WINDOW - 1)] = map.prefetch(keys[i + WINDOW]);
+    }
+}
+template<uint64_t WINDOW, typename Map, typename K>
+void contains_batch(Map& map, const K* keys, size_t n, bool* out) {
+    for(size_t i = 0; i < std::min<size_t>(n, WINDOW); i++) map.prefetch(keys[i]);
+    for(size_t i = 0; i < n; i++) {
+        uint64_t steps = 0;
+        out[i] = map.contains(keys[i], &steps);
+        if(i + WINDOW < n) map.prefetch(keys[i + WINDOW]);
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+
+inline uint64_t hardware_threads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// runs work(t) for each t below threads, on threads - 1 new threads and this one
+template<typename Work>
+void parallel(uint64_t threads, Work work) {
+    std::vector<std::thread> workers;
+    for(uint64_t t = 1; t < threads; t++) workers.emplace_back(work, t);
+    work(0);
+    for(auto& w : workers) w.join();
+}
+
+// runs body(i) for each i below n, one contiguous slice per thread; slices are kept to at
+// least MIN_SLICE so small arrays don't pay for starting threads
+template<typename Body>
+void parallel_for(uint64_t n, uint64_t threads, Body body) {
+    constexpr uint64_t MIN_SLICE = 16384;
+    threads = std::max<uint64_t>(1, std::min(threads, n / MIN_SLICE));
+    parallel(threads, [&](uint64_t t) {
+        for(uint64_t i = t * n / threads; i < (t + 1) * n / threads; i++) body(i);
+    });
+}
+
+// Takes an EMPTY slot key for claim_fill(): threads race for slots, and the one whose CAS
+// succeeds owns the slot and writes its value. Without readers nothing else needs ordering,
+// since the join publishes the array.
+inline bool claim(uint64_t& slot_key, uint64_t empty, uint64_t key) {
+    return std::atomic_ref<uint64_t>(slot_key).compare_exchange_strong(
+        empty, key, std::memory_order_relaxed);
+}
+
+// Parallel rehash for tables whose probe sequences cross the regions bulk_fill() hands out,
+// like quadratic or double hashing. Each thread takes a slice of the n old slots and walks each
+// pair's probe sequence until store(index, key, value) takes a slot for it, e.g. with claim().
+// source() is as for bulk_fill(); first_index(key, step) starts the sequence and may set a
+// per-key step, and next_index(index, step, dist) gives the slot after dist collisions.
+template<typename Source, typename First, typename Next, typename Store>
+void claim_fill(uint64_t n, uint64_t threads, Source source, First first_index, Next next_index,
+                Store store) {
+    parallel_for(n, threads, [&](uint64_t i) {
+        uint64_t key, value;
+        if(!source(i, key, value)) return;
+        uint64_t step = 0;
+        uint64_t index = first_index(key, step);
+        for(uint64_t dist = 1; !store(index, key, value); dist++) {
+            index = next_index(index, step, dist);
+        }
+    });
+}
+
+// Parallel fill of a linear-probing slot array that has already been sized for all its pairs.
+// The home slots are cut into REGION-slot regions, which fit in cache. Each thread counts its
+// share of the input per region, the counts give every region a range of one shared buffer,
+// and each thread copies its pairs there. Then each region is filled by one thread, without
+// locks: with c[h] keys at home h, those go to the slots from max(h, end of the keys before
+// them) on. That is exactly where inserting them in home order would put them, so the layout
+// is valid for both linear probing and Robin Hood. Pairs that would spill past the end of
+// their region are returned for the table to insert() serially once the regions are done.
+//
+// source(i, key, value) reads input i and returns false if it is not a pair, e.g. an empty
+// slot of the array being grown. home(key) gives the home slot, store(index, key, value)
+// writes a slot.
+struct Bulk_Result {
+    uint64_t placed;
+    // the largest distance from home among the placed pairs
+    uint64_t max_dist;
+    std::vector<std::pair<uint64_t, uint64_t>> overflow;
+};
+
+template<typename Source, typename Home, typename Store>
+Bulk_Result bulk_fill(uint64_t n, uint64_t capacity, uint64_t threads, Source source, Home home,
+                      Store store) {
+
+    constexpr uint64_t REGION = 4096;
+    const uint64_t region = std::min(REGION, capacity);
+    const uint64_t regions = capacity / region;
+    const uint64_t shift = std::bit_width(region) - 1;
+    threads = std::max<uint64_t>(1, std::min(threads, regions));
+
+    // counts[t * regions + r]: pairs from thread t's input slice homed in region r, which
+    // become where thread t writes its first pair for r
+    std::vector<uint64_t> counts(threads * regions, 0);
+    parallel(threads, [&](uint64_t t) {
+        uint64_t key, value;
+        for(uint64_t i = t * n / threads; i < (t + 1) * n / threads; i++) {
+            if(source(i, key, value)) counts[t * regions + (home(key) >> shift)]++;
+        }
+    });
+    std::vector<uint64_t> starts(regions + 1);
+    uint64_t total = 0;
+    for(uint64_t r = 0; r < regions; r++) {
+        starts[r] = total;
+        for(uint64_t t = 0; t < threads; t++) {
+            uint64_t count = counts[t * regions + r];
+            counts[t * regions + r] = total;
+            total += count;
+        }
+    }
+    starts[regions] = total;
+
+    std::vector<std::pair<uint64_t, uint64_t>> pairs(total);
+    parallel(threads, [&](uint64_t t) {
+        uint64_t key, value;
+        for(uint64_t i = t * n / threads; i < (t + 1) * n / threads; i++) {
+            if(!source(i, key, value)) continue;
+            pairs[counts[t * regions + (home(key) >> shift)]++] = {key, value};
+        }
+    });
+
+    std::vector<Bulk_Result> results(threads);
+    parallel(threads, [&](uint64_t t) {
+        Bulk_Result& result = results[t];
+        result.placed = result.max_dist = 0;
+        // next[h] starts as the count of keys at home h, then becomes the slot the next of
+        // them goes to
+        std::vector<uint64_t> next(region);
+        for(uint64_t r = t; r < regions; r += threads) {
+            const uint64_t base = r * region;
+            std::fill(next.begin(), next.end(), 0);
+            for(uint64_t i = starts[r]; i < starts[r + 1]; i++) {
+                next[home(pairs[i].first) - base]++;
+            }
+            uint64_t slot = 0;
+            for(uint64_t h = 0; h < region; h++) {
+                uint64_t count = next[h];
+                slot = std::max(slot, h);
+                next[h] = slot;
+                slot += count;
+            }
+            for(uint64_t i = starts[r]; i < starts[r + 1]; i++) {
+                uint64_t h = home(pairs[i].first) - base;
+                uint64_t index = next[h]++;
+                if(index >= region) {
+                    result.overflow.push_back(pairs[i]);
+                    continue;
+                }
+                store(base + index, pairs[i].first, pairs[i].second);
+                result.max_dist = std::max(result.max_dist, index - h);
+                result.placed++;
+            }
+        }
+    });
+
+    Bulk_Result merged{0, 0, {}};
+    for(auto& result : results) {
+        merged.placed += result.placed;
+        merged.max_dist = std::max(merged.max_dist, result.max_dist);
+        merged.overflow.insert(merged.overflow.end(), result.overflow.begin(),
+                               result.overflow.end());
+    }
+    return merged;
+}
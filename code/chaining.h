@@ -1,36 +1,30 @@
 #pragma once
 
 #include "base.h"
+#include "pool.h"
 
-template<uint64_t LF_>
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
 struct Chaining {
 
     static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    static constexpr uint64_t BATCH = 8;
 
     Chaining() {
         size_ = 0;
         capacity = 8;
+        min_load = LF * SHRINK_LOAD;
         data = reinterpret_cast<Slot**>(__aligned_alloc(CACHE_LINE, sizeof(Slot*) * capacity));
         std::memset(data, 0, sizeof(Slot*) * capacity);
     }
-    ~Chaining() {
-        for(uint64_t i = 0; i < capacity; i++) {
-            Slot* s = data[i];
-            while(s) {
-                Slot* next = s->next;
-                delete s;
-                s = next;
-            }
-        }
-        __aligned_free(data);
-    }
+    explicit Chaining(uint64_t n) : Chaining() { reserve(n); }
+    ~Chaining() { __aligned_free(data); }
 
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
         if(size_ >= capacity * LF) grow();
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
-        Slot* s = new Slot;
+        Slot* s = pool.alloc();
         s->key = key;
         s->value = value;
         s->next = data[index];
@@ -39,7 +33,7 @@ struct Chaining {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         Slot* s = data[index];
         while(s) {
@@ -52,7 +46,7 @@ struct Chaining {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         Slot* s = data[index];
         while(s) {
@@ -64,7 +58,7 @@ struct Chaining {
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         Slot* s = data[index];
         Slot* prev = nullptr;
@@ -74,8 +68,9 @@ struct Chaining {
                     prev->next = s->next;
                 else
                     data[index] = s->next;
-                delete s;
+                pool.free(s);
                 size_--;
+                if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
                 return;
             }
             prev = s;
@@ -83,17 +78,42 @@ struct Chaining {
         }
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    // also copies the nodes into a fresh pool, so chunks that erase() emptied go back to the
+    // system
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+        Pool<Slot> old_pool;
+        old_pool.swap(pool);
+        for(uint64_t i = 0; i < capacity; i++) {
+            for(Slot** s = &data[i]; *s; s = &(*s)->next) {
+                Slot* copy = pool.alloc();
+                *copy = **s;
+                *s = copy;
+            }
+        }
+    }
+
+    // reserves the nodes too
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+        pool.reserve(n);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot** old_data = data;
-        capacity *= 2;
+        capacity = new_capacity;
         data = reinterpret_cast<Slot**>(__aligned_alloc(CACHE_LINE, sizeof(Slot*) * capacity));
         std::memset(data, 0, sizeof(Slot*) * capacity);
         for(uint64_t i = 0; i < old_capacity; i++) {
             Slot* s = old_data[i];
             while(s) {
                 Slot* next = s->next;
-                uint64_t hash = squirrel3(s->key);
+                uint64_t hash = Hash{}(s->key);
                 uint64_t index = hash & (capacity - 1);
                 s->next = data[index];
                 data[index] = s;
@@ -105,19 +125,12 @@ struct Chaining {
 
     void clear() {
         size_ = 0;
-        for(uint64_t i = 0; i < capacity; i++) {
-            Slot* s = data[i];
-            while(s) {
-                Slot* next = s->next;
-                delete s;
-                s = next;
-            }
-            data[i] = nullptr;
-        }
+        std::memset(data, 0, sizeof(Slot*) * capacity);
+        pool.clear();
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         return index;
     }
@@ -137,10 +150,65 @@ struct Chaining {
         return 0;
     }
 
+    // Two stages ahead: the bucket is prefetched 2 * BATCH keys early, and the node it points
+    // to BATCH keys early, once the bucket has arrived.
+    template<typename F>
+    void batch(const uint64_t* keys, size_t n, F&& lookup) {
+        uint64_t indexed[2 * BATCH];
+        for(size_t i = 0; i < n + 2 * BATCH; i++) {
+            if(i >= 2 * BATCH) lookup(i - 2 * BATCH, indexed[i % (2 * BATCH)]);
+            if(i < n) {
+                indexed[i % (2 * BATCH)] = index_for(keys[i]);
+                ::prefetch(&data[indexed[i % (2 * BATCH)]]);
+            }
+            if(i >= BATCH && i - BATCH < n) ::prefetch(data[indexed[(i - BATCH) % (2 * BATCH)]]);
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        batch(keys, n, [&](size_t i, uint64_t index) {
+            uint64_t steps = 0;
+            out[i] = find_indexed(keys[i], index, &steps);
+        });
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        batch(keys, n, [&](size_t i, uint64_t index) {
+            Slot* s = data[index];
+            while(s && s->key != keys[i]) s = s->next;
+            out[i] = s != nullptr;
+        });
+    }
+
+    // one lookup for find_amac(): the first step reads the bucket, every later one a node
+    struct Slot;
+    struct Probe {
+        uint64_t key, index, value;
+        Slot* node;
+    };
+    void probe_start(Probe& p, uint64_t key) {
+        p.key = key;
+        p.index = index_for(key);
+        p.node = nullptr;
+        ::prefetch(&data[p.index]);
+    }
+    bool probe_step(Probe& p) {
+        if(!p.node) {
+            p.node = data[p.index];
+        } else if(p.node->key == p.key) {
+            p.value = p.node->value;
+            return true;
+        } else {
+            p.node = p.node->next;
+        }
+        ::prefetch(p.node);
+        return false;
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() {
-        return sizeof(Slot*) * capacity + sizeof(Slot) * size_ + sizeof(Chaining);
+        return sizeof(Slot*) * capacity + pool.memory_usage() + sizeof(Chaining);
     }
 
     uint64_t sum_all_values() {
@@ -160,6 +228,8 @@ struct Chaining {
         Slot* next;
     };
     Slot** data;
+    Pool<Slot> pool;
     uint64_t capacity;
     uint64_t size_;
+    double min_load;
 };
\ No newline at end of file
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "base.h"
+#include "pool.h"
+
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
+struct Chaining_Unrolled {
+
+    struct Node;
+
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    static constexpr uint64_t NODE = 3;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
+
+    Chaining_Unrolled() {
+        size_ = 0;
+        capacity = 8;
+        min_load = LF * SHRINK_LOAD;
+        data = reinterpret_cast<Node*>(__aligned_alloc(CACHE_LINE, sizeof(Node) * capacity));
+        reset();
+    }
+    explicit Chaining_Unrolled(uint64_t n) : Chaining_Unrolled() { reserve(n); }
+    ~Chaining_Unrolled() { __aligned_free(data); }
+
+    void reset() {
+        for(uint64_t i = 0; i < capacity; i++) {
+            std::memset(data[i].keys, 0xff, sizeof(data[i].keys));
+            data[i].next = nullptr;
+        }
+    }
+
+    // assumes key is not in the map
+    void insert(uint64_t key, uint64_t value) {
+        if(size_ >= capacity * LF) grow();
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        size_++;
+        for(Node* n = &data[index]; n; n = n->next) {
+            for(uint64_t i = 0; i < NODE; i++) {
+                if(n->keys[i] == EMPTY) {
+                    n->keys[i] = key;
+                    n->values[i] = value;
+                    return;
+                }
+            }
+        }
+        // the first node stays inline in the bucket array, so overflow goes right behind it
+        Node* n = pool.alloc();
+        std::memset(n->keys, 0xff, sizeof(n->keys));
+        n->keys[0] = key;
+        n->values[0] = value;
+        n->next = data[index].next;
+        data[index].next = n;
+    }
+
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        return find_indexed(key, index, steps);
+    }
+
+    bool contains(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        Node* n = &data[index];
+        for(;;) {
+            for(uint64_t i = 0; i < NODE; i++) {
+                if(n->keys[i] == key) return true;
+            }
+            n = n->next;
+            if(!n) return false;
+            (*steps)++;
+        }
+    }
+
+    void erase(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        Node* prev = nullptr;
+        for(Node* n = &data[index];; prev = n, n = n->next) {
+            for(uint64_t i = 0; i < NODE; i++) {
+                if(n->keys[i] == key) {
+                    n->keys[i] = EMPTY;
+                    size_--;
+                    if(prev && n->keys[0] == EMPTY && n->keys[1] == EMPTY &&
+                       n->keys[2] == EMPTY) {
+                        prev->next = n->next;
+                        pool.free(n);
+                    }
+                    if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
+                    return;
+                }
+            }
+        }
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    // also rebuilds the overflow nodes in a fresh pool, so chunks that erase() emptied go back
+    // to the system
+    void shrink_to_fit() {
+        Pool<Node> old_pool;
+        old_pool.swap(pool);
+        resize(capacity_for(size_, LF), old_pool);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) { resize(new_capacity, pool); }
+    // the old overflow nodes go back to from
+    void resize(uint64_t new_capacity, Pool<Node>& from) {
+        uint64_t old_capacity = capacity;
+        Node* old_data = data;
+        size_ = 0;
+        capacity = new_capacity;
+        data = reinterpret_cast<Node*>(__aligned_alloc(CACHE_LINE, sizeof(Node) * capacity));
+        reset();
+        for(uint64_t i = 0; i < old_capacity; i++) {
+            Node* n = &old_data[i];
+            while(n) {
+                for(uint64_t j = 0; j < NODE; j++) {
+                    if(n->keys[j] != EMPTY) insert(n->keys[j], n->values[j]);
+                }
+                Node* next = n->next;
+                if(n != &old_data[i]) from.free(n);
+                n = next;
+            }
+        }
+        __aligned_free(old_data);
+    }
+
+    void clear() {
+        size_ = 0;
+        reset();
+        pool.clear();
+    }
+
+    uint64_t index_for(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        return index;
+    }
+    uint64_t prefetch(uint64_t key) {
+        uint64_t index = index_for(key);
+        ::prefetch(&data[index]);
+        return index;
+    }
+    uint64_t find_indexed(uint64_t key, uint64_t index, uint64_t* steps) {
+        Node* n = &data[index];
+        for(;;) {
+            for(uint64_t i = 0; i < NODE; i++) {
+                if(n->keys[i] == key) return n->values[i];
+            }
+            (*steps)++;
+            n = n->next;
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // one lookup for find_amac(): each step scans one node
+    struct Probe {
+        uint64_t key, value;
+        Node* node;
+    };
+    void probe_start(Probe& p, uint64_t key) {
+        p.key = key;
+        p.node = &data[prefetch(key)];
+    }
+    bool probe_step(Probe& p) {
+        for(uint64_t i = 0; i < NODE; i++) {
+            if(p.node->keys[i] == p.key) {
+                p.value = p.node->values[i];
+                return true;
+            }
+        }
+        p.node = p.node->next;
+        ::prefetch(p.node);
+        return false;
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() {
+        return sizeof(Node) * capacity + pool.memory_usage() + sizeof(Chaining_Unrolled);
+    }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < capacity; i++) {
+            for(Node* n = &data[i]; n; n = n->next) {
+                for(uint64_t j = 0; j < NODE; j++) {
+                    if(n->keys[j] != EMPTY) sum += n->values[j];
+                }
+            }
+        }
+        return sum;
+    }
+
+    // one cache line: three pairs and the link to the next node
+    struct Node {
+        uint64_t keys[NODE];
+        uint64_t values[NODE];
+        Node* next;
+        uint64_t pad;
+    };
+    Node* data;
+    Pool<Node> pool;
+    uint64_t capacity;
+    uint64_t size_;
+    double min_load;
+};
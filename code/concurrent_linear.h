@@ -0,0 +1,515 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "base.h"
+
+// Counter split across cache lines so threads bumping it don't all contend on one line
+struct Striped_Counter {
+
+    static constexpr uint64_t STRIPES = 32;
+
+    Striped_Counter() { clear(); }
+
+    // returns the new value of this thread's stripe
+    int64_t add(int64_t n) {
+        return stripes[stripe()].value.fetch_add(n, std::memory_order_relaxed) + n;
+    }
+    int64_t sum() {
+        int64_t sum = 0;
+        for(uint64_t i = 0; i < STRIPES; i++) {
+            sum += stripes[i].value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+    void clear() {
+        for(uint64_t i = 0; i < STRIPES; i++) {
+            stripes[i].value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static uint64_t stripe() {
+        static std::atomic<uint64_t> next{0};
+        thread_local uint64_t index = next.fetch_add(1) % STRIPES;
+        return index;
+    }
+
+    struct alignas(CACHE_LINE) Stripe {
+        std::atomic<int64_t> value;
+    };
+    Stripe stripes[STRIPES];
+};
+
+// Epoch-based reclamation. Every operation announces the global epoch it started in, and the
+// epoch only moves on once every thread in an operation has announced the current one. So
+// once it has moved on twice since something was unlinked, no thread can still hold it. The
+// announcements live in one registry for all maps; a thread takes a record on first use and
+// hands it back when it exits.
+struct Epochs {
+
+    static constexpr uint64_t IDLE = UINT64_MAX;
+
+    struct alignas(CACHE_LINE) Record {
+        std::atomic<uint64_t> epoch{IDLE};
+        std::atomic<bool> taken{true};
+        Record* next = nullptr;
+        // guards nest, e.g. find_batch() running find()
+        uint64_t depth = 0;
+    };
+
+    static inline std::atomic<uint64_t> global{0};
+    static inline std::atomic<Record*> records{nullptr};
+
+    static Record& mine() {
+        struct Owner {
+            Record* record = take();
+            ~Owner() { record->taken.store(false); }
+        };
+        thread_local Owner owner;
+        return *owner.record;
+    }
+    static Record* take() {
+        for(Record* r = records.load(); r; r = r->next) {
+            bool expected = false;
+            if(!r->taken.load() && r->taken.compare_exchange_strong(expected, true)) return r;
+        }
+        Record* r = new Record;
+        r->next = records.load();
+        while(!records.compare_exchange_weak(r->next, r));
+        return r;
+    }
+
+    // pins the epoch for its lifetime; pointers into a map must be loaded after it starts
+    struct Guard {
+        Record& record;
+        Guard() : record(mine()) {
+            if(record.depth++ == 0) record.epoch.store(global.load());
+        }
+        ~Guard() {
+            if(--record.depth == 0) record.epoch.store(IDLE);
+        }
+    };
+
+    // moves the epoch on if every thread in an operation has seen it, and returns it
+    static uint64_t advance() {
+        uint64_t e = global.load();
+        for(Record* r = records.load(); r; r = r->next) {
+            uint64_t seen = r->epoch.load();
+            if(seen != IDLE && seen != e) return e;
+        }
+        global.compare_exchange_strong(e, e + 1);
+        return global.load();
+    }
+};
+
+// Lock-free linear probing. Keys are claimed with a CAS and never change afterwards, so an
+// erased key stays behind as a tombstone whose value is ERASED. Reads never wait, and only write
+// their thread's epoch announcement.
+// When an array fills up a larger one is linked as its successor; every writer then migrates
+// a chunk of the old array before doing its own work, and the map switches over once all
+// chunks are done. Migrating a slot first freezes its value, copies it, then marks it MOVED;
+// the thread that froze it does the copy, and writers that meet it frozen wait for it.
+//
+// An erase that leaves fewer than min_load of the slots live starts a migration as well, and a
+// migration that finds that few live keys halves the array instead of keeping its size. Erases
+// start at most one such migration per doubling so far, so churn around a size can't thrash.
+//
+// The array a migration leaves is retired, and freed by a later grow() or switch once the epochs
+// show no operation can still be reading it.
+//
+// Keys must not be EMPTY and values must fit in 62 bits. clear(), sum_all_values(),
+// memory_usage(), shrink_to_fit(), reserve() and the destructor need exclusive access; they
+// also finish any pending migration and free the retired arrays.
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
+struct Concurrent_Linear {
+
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    static constexpr uint64_t PENDING = UINT64_MAX;
+    static constexpr uint64_t MOVED = UINT64_MAX - 1;
+    static constexpr uint64_t ERASED = UINT64_MAX - 2;
+    static constexpr uint64_t FROZEN = 1ull << 63;
+    static constexpr uint64_t CHUNK = 1024;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
+
+    struct Slot;
+    struct Array;
+
+    Concurrent_Linear() {
+        current = make_array(8);
+        retired = nullptr;
+        reclaiming = false;
+        shrinks = 0;
+        min_load = LF * SHRINK_LOAD;
+    }
+    explicit Concurrent_Linear(uint64_t n) : Concurrent_Linear() { reserve(n); }
+    ~Concurrent_Linear() {
+        quiesce();
+        free_array(current.load());
+    }
+
+    static bool frozen(uint64_t value) { return value < ERASED && (value & FROZEN); }
+
+    Array* make_array(uint64_t capacity) {
+        Array* a = new Array;
+        a->capacity = capacity;
+        a->data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        for(uint64_t i = 0; i < capacity; i++) {
+            a->data[i].key.store(EMPTY, std::memory_order_relaxed);
+            a->data[i].value.store(PENDING, std::memory_order_relaxed);
+        }
+        a->next.store(nullptr);
+        a->copy_index.store(0);
+        a->copied.store(0);
+        a->retired = nullptr;
+        return a;
+    }
+    void free_array(Array* a) {
+        __aligned_free(a->data);
+        delete a;
+    }
+
+    // inserts or overwrites; safe to call concurrently with anything but the exclusive calls
+    void insert(uint64_t key, uint64_t value) {
+        Epochs::Guard guard;
+        put(current.load(), key, value, false);
+    }
+
+    // with copy set, only fills a slot that has no value yet, so racing migrators agree
+    void put(Array* a, uint64_t key, uint64_t value, bool copy) {
+        uint64_t hash = Hash{}(key);
+        for(;;) {
+            Array* next = a->next.load();
+            if(next && !copy) help(a);
+            uint64_t index = hash & (a->capacity - 1);
+            Slot* s = nullptr;
+            for(uint64_t dist = 0; dist < a->capacity; dist++) {
+                uint64_t k = a->data[index].key.load();
+                // new keys go to the successor once a migration has started
+                if(k == EMPTY && next && !copy) break;
+                if(k == EMPTY && a->data[index].key.compare_exchange_strong(k, key)) {
+                    int64_t claimed = a->claimed.add(1);
+                    if(a->capacity <= CHUNK * 64 || (claimed & 63) == 0) {
+                        if(a->claimed.sum() >= a->capacity * LF) grow(a);
+                    }
+                    s = &a->data[index];
+                    break;
+                }
+                if(k == key) {
+                    s = &a->data[index];
+                    break;
+                }
+                index = (index + 1) & (a->capacity - 1);
+            }
+            if(!s) {
+                if(!next) grow(a);
+                a = a->next.load();
+                continue;
+            }
+            uint64_t v = s->value.load();
+            for(;;) {
+                // Once there is a successor, an insert of this key may have passed the slot
+                // while it was still EMPTY and gone there, so a key never published here is
+                // not published here anymore. copy_slot() marks the slot MOVED instead.
+                if(v == PENDING && !copy && a->next.load()) {
+                    copy_slot(a, s - a->data);
+                    break;
+                }
+                if(v == MOVED || frozen(v)) {
+                    if(frozen(v)) copy_slot(a, s - a->data);
+                    break;
+                }
+                if(copy && v != PENDING) return;
+                if(s->value.compare_exchange_weak(v, value)) {
+                    if(!copy && (v == PENDING || v == ERASED)) live.add(1);
+                    return;
+                }
+            }
+            a = a->next.load();
+        }
+    }
+
+    // returns false if the key is not present
+    bool get(uint64_t key, uint64_t hash, uint64_t* value, uint64_t* steps) {
+        Epochs::Guard guard;
+        Array* a = current.load();
+        while(a) {
+            uint64_t index = hash & (a->capacity - 1);
+            for(uint64_t dist = 0; dist < a->capacity; dist++) {
+                uint64_t k = a->data[index].key.load();
+                if(k == EMPTY) break;
+                if(k == key) {
+                    uint64_t v = a->data[index].value.load();
+                    // a PENDING key may have been published in the successor instead, see put()
+                    if(v == MOVED || v == PENDING) break;
+                    if(v == ERASED) return false;
+                    *value = v & ~FROZEN;
+                    return true;
+                }
+                (*steps)++;
+                index = (index + 1) & (a->capacity - 1);
+            }
+            a = a->next.load();
+        }
+        return false;
+    }
+
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        uint64_t value = 0;
+        get(key, Hash{}(key), &value, steps);
+        return value;
+    }
+
+    bool contains(uint64_t key, uint64_t* steps) {
+        uint64_t value;
+        return get(key, Hash{}(key), &value, steps);
+    }
+
+    // no-op if the key is not present
+    void erase(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        Epochs::Guard guard;
+        Array* a = current.load();
+        while(a) {
+            Array* next = a->next.load();
+            if(next) help(a);
+            uint64_t index = hash & (a->capacity - 1);
+            Slot* s = nullptr;
+            for(uint64_t dist = 0; dist < a->capacity; dist++) {
+                uint64_t k = a->data[index].key.load();
+                if(k == EMPTY) break;
+                if(k == key) {
+                    s = &a->data[index];
+                    break;
+                }
+                index = (index + 1) & (a->capacity - 1);
+            }
+            if(s) {
+                uint64_t v = s->value.load();
+                for(;;) {
+                    if(v == ERASED || (v == PENDING && !a->next.load())) return;
+                    if(v == MOVED || v == PENDING || frozen(v)) {
+                        if(frozen(v)) copy_slot(a, s - a->data);
+                        break;
+                    }
+                    if(s->value.compare_exchange_weak(v, ERASED)) {
+                        // sampled like the load check in put()
+                        int64_t stripe = live.add(-1);
+                        if(a->capacity <= CHUNK * 64 || (stripe & 63) == 0) {
+                            if(live.sum() < a->capacity * min_load && a->capacity > 8 &&
+                               take_shrink()) {
+                                if(!grow(a)) shrinks.fetch_add(1);
+                            }
+                        }
+                        return;
+                    }
+                }
+            }
+            a = a->next.load();
+        }
+    }
+
+    // returns false if a already had a successor
+    bool grow(Array* a) {
+        if(a->next.load()) return false;
+        // tombstones are dropped by the migration, so only grow if the live keys need it
+        uint64_t capacity = a->capacity;
+        double live_keys = static_cast<double>(live.sum());
+        if(live_keys * 2 >= capacity * LF)
+            capacity *= 2;
+        else if(live_keys < capacity * min_load && capacity > 8)
+            capacity /= 2;
+        Array* n = make_array(capacity);
+        Array* expected = nullptr;
+        if(!a->next.compare_exchange_strong(expected, n)) {
+            free_array(n);
+            return false;
+        }
+        if(n->capacity > a->capacity) shrinks.fetch_add(1);
+        reclaim();
+        return true;
+    }
+
+    bool take_shrink() {
+        uint64_t n = shrinks.load();
+        while(n && !shrinks.compare_exchange_weak(n, n - 1));
+        return n != 0;
+    }
+
+    void copy_slot(Array* a, uint64_t i) {
+        Slot& s = a->data[i];
+        uint64_t v = s.value.load();
+        for(;;) {
+            if(v == MOVED) return;
+            if(v == PENDING || v == ERASED) {
+                // an insert that claimed this key but has not published yet will fail its
+                // CAS and retry in the successor
+                if(s.value.compare_exchange_weak(v, MOVED)) return;
+                continue;
+            }
+            // the thread that froze the slot copies it and the others wait for MOVED. A second
+            // copier could land after the key had been erased in the successor and the
+            // tombstone dropped by the successor's own migration, bringing the value back.
+            if(frozen(v)) {
+                std::this_thread::yield();
+                v = s.value.load();
+                continue;
+            }
+            if(!s.value.compare_exchange_weak(v, v | FROZEN)) continue;
+            put(a->next.load(), s.key.load(), v, true);
+            s.value.store(MOVED);
+            return;
+        }
+    }
+
+    // migrate one chunk of a into its successor
+    void help(Array* a) {
+        uint64_t start = a->copy_index.fetch_add(CHUNK);
+        if(start >= a->capacity) return;
+        uint64_t end = std::min(start + CHUNK, a->capacity);
+        for(uint64_t i = start; i < end; i++) copy_slot(a, i);
+        if(a->copied.fetch_add(end - start) + (end - start) == a->capacity) promote();
+    }
+
+    void promote() {
+        for(;;) {
+            Array* a = current.load();
+            if(!a->next.load() || a->copied.load() != a->capacity) return;
+            if(current.compare_exchange_strong(a, a->next.load())) {
+                a->retired_at = Epochs::global.load();
+                retire(a);
+                reclaim();
+            }
+        }
+    }
+
+    void retire(Array* a) {
+        a->retired = retired.load();
+        while(!retired.compare_exchange_weak(a->retired, a));
+    }
+
+    // frees the retired arrays the epochs say no operation can reach; one thread at a time,
+    // the others skip it
+    void reclaim() {
+        if(reclaiming.exchange(true)) return;
+        uint64_t epoch = Epochs::advance();
+        Array* a = retired.exchange(nullptr);
+        while(a) {
+            Array* next = a->retired;
+            if(a->retired_at + 2 <= epoch)
+                free_array(a);
+            else
+                retire(a);
+            a = next;
+        }
+        reclaiming.store(false);
+    }
+
+    void quiesce() {
+        for(Array* a = current.load(); a->next.load(); a = current.load()) {
+            while(a->copy_index.load() < a->capacity) help(a);
+        }
+        Array* a = retired.exchange(nullptr);
+        while(a) {
+            Array* next = a->retired;
+            free_array(a);
+            a = next;
+        }
+    }
+
+    // migrates to the smallest array that holds the live keys without growing
+    void shrink_to_fit() {
+        quiesce();
+        uint64_t fit = capacity_for(live.sum(), LF);
+        if(fit < current.load()->capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        quiesce();
+        uint64_t want = capacity_for(n, LF);
+        if(want > current.load()->capacity) resize(want);
+    }
+
+    // runs a whole migration to a new array of the given capacity
+    void resize(uint64_t capacity) {
+        current.load()->next.store(make_array(capacity));
+        quiesce();
+    }
+
+    void clear() {
+        quiesce();
+        Array* a = current.load();
+        for(uint64_t i = 0; i < a->capacity; i++) {
+            a->data[i].key.store(EMPTY, std::memory_order_relaxed);
+            a->data[i].value.store(PENDING, std::memory_order_relaxed);
+        }
+        a->claimed.clear();
+        live.clear();
+    }
+
+    uint64_t index_for(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        return hash;
+    }
+    uint64_t prefetch(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        Epochs::Guard guard;
+        Array* a = current.load();
+        ::prefetch(&a->data[hash & (a->capacity - 1)]);
+        return hash;
+    }
+    uint64_t find_indexed(uint64_t key, uint64_t hash, uint64_t* steps) {
+        uint64_t value = 0;
+        get(key, hash, &value, steps);
+        return value;
+    }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return live.sum(); }
+
+    uint64_t memory_usage() {
+        quiesce();
+        return sizeof(Slot) * current.load()->capacity + sizeof(Array) + sizeof(Concurrent_Linear);
+    }
+
+    uint64_t sum_all_values() {
+        quiesce();
+        Array* a = current.load();
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < a->capacity; i++) {
+            uint64_t v = a->data[i].value.load(std::memory_order_relaxed);
+            if(v != PENDING && v != ERASED) sum += v;
+        }
+        return sum;
+    }
+
+    struct Slot {
+        std::atomic<uint64_t> key, value;
+    };
+    struct Array {
+        Slot* data;
+        uint64_t capacity;
+        Striped_Counter claimed;
+        std::atomic<Array*> next;
+        std::atomic<uint64_t> copy_index;
+        std::atomic<uint64_t> copied;
+        Array* retired;
+        // the epoch when current moved past it
+        uint64_t retired_at;
+    };
+    std::atomic<Array*> current;
+    std::atomic<Array*> retired;
+    std::atomic<bool> reclaiming;
+    // doublings not yet answered by a shrink an erase started
+    std::atomic<uint64_t> shrinks;
+    Striped_Counter live;
+    double min_load;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+#include "base.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters for the calling thread, user space only. Each counter is opened on its own
+// so that one the machine (or a VM, or perf_event_paranoid) doesn't allow only drops that
+// column instead of all of them. If the kernel has to multiplex, values are scaled up by the
+// fraction of time the counter was actually scheduled.
+struct Perf_Counters {
+
+    static constexpr uint64_t COUNT = 6;
+    static constexpr const char* NAMES[COUNT] = {
+        "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"};
+
+    Perf_Counters() {
+        for(uint64_t i = 0; i < COUNT; i++) {
+            fds[i] = open(i);
+            values[i] = 0;
+        }
+    }
+    ~Perf_Counters() {
+#ifdef __linux__
+        for(uint64_t i = 0; i < COUNT; i++) {
+            if(fds[i] >= 0) close(fds[i]);
+        }
+#endif
+    }
+
+#ifdef __linux__
+    static int open(uint64_t i) {
+        constexpr uint64_t READ_MISS = PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                                       PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        constexpr std::pair<uint32_t, uint64_t> EVENTS[COUNT] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | READ_MISS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | READ_MISS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | READ_MISS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}};
+
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = EVENTS[i].first;
+        attr.config = EVENTS[i].second;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    void start() {
+        for(uint64_t i = 0; i < COUNT; i++) {
+            if(fds[i] < 0) continue;
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void stop() {
+        for(uint64_t i = 0; i < COUNT; i++) {
+            if(fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for(uint64_t i = 0; i < COUNT; i++) {
+            if(fds[i] < 0) continue;
+            uint64_t data[3] = {};
+            if(read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+                values[i] = 0;
+                continue;
+            }
+            values[i] = static_cast<uint64_t>(static_cast<double>(data[0]) *
+                                              static_cast<double>(data[1]) /
+                                              static_cast<double>(data[2]));
+        }
+    }
+#else
+    static int open(uint64_t) { return -1; }
+    void start() {}
+    void stop() {}
+#endif
+
+    bool available(uint64_t i) { return fds[i] >= 0; }
+
+    // stores the last start()/stop() window as phase_<counter>, skipping unavailable counters
+    void record(std::unordered_map<std::string, uint64_t>& results, const std::string& phase) {
+        for(uint64_t i = 0; i < COUNT; i++) {
+            if(available(i)) results[phase + "_" + NAMES[i]] = values[i];
+        }
+    }
+
+    int fds[COUNT];
+    uint64_t values[COUNT];
+};
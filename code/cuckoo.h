@@ -0,0 +1,280 @@
+#pragma once
+
+#include "base.h"
+
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
+struct Cuckoo {
+
+    static constexpr uint64_t BUCKET = 4;
+    static constexpr uint64_t STASH = 8;
+    static constexpr int32_t MAX_BFS = 256;
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    // prefetch() touches two lines per key
+    static constexpr uint64_t BATCH = 8;
+
+    Cuckoo() {
+        size_ = 0;
+        stash_size = 0;
+        capacity = 8;
+        min_load = LF * SHRINK_LOAD;
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+    }
+    explicit Cuckoo(uint64_t n) : Cuckoo() { reserve(n); }
+    ~Cuckoo() { __aligned_free(data); }
+
+    uint64_t alternate(uint64_t key, uint64_t index) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index_1 = hash & (capacity - 1);
+        uint64_t index_2 = (hash >> 32) & (capacity - 1);
+        return index == index_1 ? index_2 : index_1;
+    }
+
+    int32_t match(uint64_t index, uint64_t key) {
+        __m256i test = _mm256_load_si256(reinterpret_cast<__m256i*>(data[index].keys));
+        __m256i cmp = _mm256_cmpeq_epi64(test, _mm256_set1_epi64x(key));
+        return _mm256_movemask_epi8(cmp);
+    }
+
+    // assumes key is not in the map
+    void insert(uint64_t key, uint64_t value) {
+        if(size_ >= capacity * BUCKET * LF) grow();
+        uint64_t hash = Hash{}(key);
+        uint64_t index_1 = hash & (capacity - 1);
+        uint64_t index_2 = (hash >> 32) & (capacity - 1);
+        int32_t mask_1 = match(index_1, EMPTY);
+        int32_t mask_2 = match(index_2, EMPTY);
+        if(mask_1 || mask_2) {
+            int32_t n_1 = mask_1 ? __ctz(mask_1) >> 3 : static_cast<int32_t>(BUCKET);
+            int32_t n_2 = mask_2 ? __ctz(mask_2) >> 3 : static_cast<int32_t>(BUCKET);
+            if(n_1 <= n_2) {
+                data[index_1].keys[n_1] = key;
+                data[index_1].values[n_1] = value;
+            } else {
+                data[index_2].keys[n_2] = key;
+                data[index_2].values[n_2] = value;
+            }
+            size_++;
+            return;
+        }
+        if(displace(index_1, index_2, key, value)) {
+            size_++;
+            return;
+        }
+        if(stash_size < STASH) {
+            stash[stash_size].key = key;
+            stash[stash_size].value = value;
+            stash_size++;
+            size_++;
+            return;
+        }
+        grow();
+        insert(key, value);
+    }
+
+    // breadth-first search for the shortest chain of evictions that ends in a free slot,
+    // then shift every entry on the chain into its alternate bucket back to front
+    bool displace(uint64_t index_1, uint64_t index_2, uint64_t key, uint64_t value) {
+        struct Step {
+            uint64_t index;
+            int32_t parent, slot;
+        };
+        Step queue[MAX_BFS];
+        int32_t head = 0, tail = 0;
+        queue[tail++] = {index_1, -1, -1};
+        if(index_2 != index_1) queue[tail++] = {index_2, -1, -1};
+
+        for(; head < tail; head++) {
+            uint64_t index = queue[head].index;
+            for(int32_t i = 0; i < static_cast<int32_t>(BUCKET); i++) {
+                uint64_t alt = alternate(data[index].keys[i], index);
+                if(alt == index) continue;
+                int32_t mask = match(alt, EMPTY);
+                if(mask) {
+                    int32_t free = __ctz(mask) >> 3;
+                    data[alt].keys[free] = data[index].keys[i];
+                    data[alt].values[free] = data[index].values[i];
+                    int32_t step = head, slot = i;
+                    while(queue[step].parent >= 0) {
+                        Step& to = queue[step];
+                        Step& from = queue[to.parent];
+                        data[to.index].keys[slot] = data[from.index].keys[to.slot];
+                        data[to.index].values[slot] = data[from.index].values[to.slot];
+                        slot = to.slot;
+                        step = to.parent;
+                    }
+                    data[queue[step].index].keys[slot] = key;
+                    data[queue[step].index].values[slot] = value;
+                    return true;
+                }
+                if(tail == MAX_BFS) continue;
+                // a bucket may appear only once on a path, or the shifts would clobber it
+                bool cycle = false;
+                for(int32_t step = head; step >= 0 && !cycle; step = queue[step].parent) {
+                    cycle = queue[step].index == alt;
+                }
+                if(!cycle) queue[tail++] = {alt, head, i};
+            }
+        }
+        return false;
+    }
+
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        return find_indexed(key, hash, steps);
+    }
+
+    bool contains(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index_1 = hash & (capacity - 1);
+        if(match(index_1, key)) return true;
+        (*steps)++;
+        uint64_t index_2 = (hash >> 32) & (capacity - 1);
+        if(match(index_2, key)) return true;
+        for(uint64_t i = 0; i < stash_size; i++) {
+            (*steps)++;
+            if(stash[i].key == key) return true;
+        }
+        return false;
+    }
+
+    void erase(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index_1 = hash & (capacity - 1);
+        uint64_t index_2 = (hash >> 32) & (capacity - 1);
+        int32_t mask_1 = match(index_1, key);
+        int32_t mask_2 = match(index_2, key);
+        if(mask_1 || mask_2) {
+            uint64_t index = mask_1 ? index_1 : index_2;
+            int32_t i = __ctz(mask_1 ? mask_1 : mask_2) >> 3;
+            data[index].keys[i] = EMPTY;
+            size_--;
+            if(stash_size) unstash(index, i);
+            if(size_ < capacity * BUCKET * min_load && capacity > 8) resize(capacity / 2);
+            return;
+        }
+        for(uint64_t i = 0; i < stash_size; i++) {
+            if(stash[i].key == key) {
+                stash[i] = stash[--stash_size];
+                size_--;
+                if(size_ < capacity * BUCKET * min_load && capacity > 8) resize(capacity / 2);
+                return;
+            }
+        }
+    }
+
+    // move a stashed entry into a slot freed by erase, if one belongs there
+    void unstash(uint64_t index, int32_t slot) {
+        for(uint64_t i = 0; i < stash_size; i++) {
+            uint64_t hash = Hash{}(stash[i].key);
+            if((hash & (capacity - 1)) == index || ((hash >> 32) & (capacity - 1)) == index) {
+                data[index].keys[slot] = stash[i].key;
+                data[index].values[slot] = stash[i].value;
+                stash[i] = stash[--stash_size];
+                return;
+            }
+        }
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, BUCKET * LF);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, BUCKET * LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
+        uint64_t old_capacity = capacity;
+        uint64_t old_stash_size = stash_size;
+        Slot* old_data = data;
+        Entry old_stash[STASH];
+        std::memcpy(old_stash, stash, sizeof(stash));
+        size_ = 0;
+        stash_size = 0;
+        capacity = new_capacity;
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+        for(uint64_t i = 0; i < old_capacity; i++) {
+            for(uint64_t j = 0; j < BUCKET; j++) {
+                if(old_data[i].keys[j] != EMPTY) insert(old_data[i].keys[j], old_data[i].values[j]);
+            }
+        }
+        for(uint64_t i = 0; i < old_stash_size; i++) insert(old_stash[i].key, old_stash[i].value);
+        __aligned_free(old_data);
+    }
+
+    void clear() {
+        size_ = 0;
+        stash_size = 0;
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+    }
+
+    uint64_t index_for(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        return hash;
+    }
+    uint64_t prefetch(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index_1 = hash & (capacity - 1);
+        uint64_t index_2 = (hash >> 32) & (capacity - 1);
+        ::prefetch(&data[index_1]);
+        ::prefetch(&data[index_2]);
+        return hash;
+    }
+    uint64_t find_indexed(uint64_t key, uint64_t hash, uint64_t* steps) {
+        uint64_t index_1 = hash & (capacity - 1);
+        int32_t mask_1 = match(index_1, key);
+        if(mask_1) return data[index_1].values[__ctz(mask_1) >> 3];
+        (*steps)++;
+        uint64_t index_2 = (hash >> 32) & (capacity - 1);
+        int32_t mask_2 = match(index_2, key);
+        if(mask_2) return data[index_2].values[__ctz(mask_2) >> 3];
+        for(uint64_t i = 0;; i++) {
+            (*steps)++;
+            if(stash[i].key == key) return stash[i].value;
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Cuckoo); }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < capacity; i++) {
+            for(uint64_t j = 0; j < BUCKET; j++) {
+                if(data[i].keys[j] != EMPTY) sum += data[i].values[j];
+            }
+        }
+        for(uint64_t i = 0; i < stash_size; i++) sum += stash[i].value;
+        return sum;
+    }
+
+    struct Slot {
+        uint64_t keys[BUCKET];
+        uint64_t values[BUCKET];
+    };
+    struct Entry {
+        uint64_t key, value;
+    };
+    Slot* data;
+    uint64_t capacity;
+    uint64_t size_;
+    uint64_t stash_size;
+    Entry stash[STASH];
+    double min_load;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "base.h"
+
+// Entries are appended to a packed array in insertion order, and a linear probing index of
+// 32-bit positions maps hashes to them. The index is a quarter the size of Linear's slots, and
+// iterating only scans live entries. Erasing leaves a hole in the entries that grow() squeezes
+// out, keeping the order; the newest entry is just popped. If squeezing frees half the room,
+// grow() keeps the capacity.
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
+struct Dense {
+
+    // index sentinels; an erased entry has its key set to ERASED
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    static constexpr uint32_t DELETED = UINT32_MAX - 1;
+    static constexpr uint64_t ERASED = UINT64_MAX;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    // prefetch() only reaches the index; the entry behind it is a dependent miss
+    static constexpr uint64_t BATCH = 16;
+
+    Dense() {
+        size_ = used = 0;
+        capacity = 8;
+        min_load = LF * SHRINK_LOAD;
+        index = reinterpret_cast<uint32_t*>(__aligned_alloc(CACHE_LINE, capacity * 4));
+        entries = reinterpret_cast<Entry*>(__aligned_alloc(CACHE_LINE, limit() * sizeof(Entry)));
+        std::memset(index, 0xff, capacity * 4);
+    }
+    explicit Dense(uint64_t n) : Dense() { reserve(n); }
+    ~Dense() {
+        __aligned_free(index);
+        __aligned_free(entries);
+    }
+
+    // entries needed before the next grow()
+    uint64_t limit() { return static_cast<uint64_t>(capacity * LF) + 1; }
+
+    void place(uint32_t pos) {
+        uint64_t i = Hash{}(entries[pos].key) & (capacity - 1);
+        while(index[i] < DELETED) { i = (i + 1) & (capacity - 1); }
+        index[i] = pos;
+    }
+
+    // assumes key is not in the map
+    void insert(uint64_t key, uint64_t value) {
+        if(used >= capacity * LF) grow();
+        entries[used].key = key;
+        entries[used].value = value;
+        place(static_cast<uint32_t>(used));
+        used++;
+        size_++;
+    }
+
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        uint64_t i = index_for(key);
+        return find_indexed(key, i, steps);
+    }
+
+    bool contains(uint64_t key, uint64_t* steps) {
+        uint64_t i = index_for(key);
+        uint64_t dist = 0;
+        while(index[i] != EMPTY) {
+            if(dist++ == capacity) return false;
+            if(index[i] != DELETED && entries[index[i]].key == key) return true;
+            (*steps)++;
+            i = (i + 1) & (capacity - 1);
+        }
+        return false;
+    }
+
+    void erase(uint64_t key) {
+        uint64_t i = index_for(key);
+        for(;;) {
+            uint32_t pos = index[i];
+            if(pos != DELETED && entries[pos].key == key) {
+                index[i] = DELETED;
+                if(pos == used - 1)
+                    used--;
+                else
+                    entries[pos].key = ERASED;
+                size_--;
+                if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
+                return;
+            }
+            i = (i + 1) & (capacity - 1);
+        }
+    }
+
+    void grow() { resize(size_ >= capacity * LF / 2 ? capacity * 2 : capacity); }
+
+    // also squeezes out the erased entries
+    void shrink_to_fit() { resize(capacity_for(size_, LF)); }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
+        uint64_t old_capacity = capacity;
+        Entry* old_entries = entries;
+        capacity = new_capacity;
+        // positions have to fit in the index, below the sentinels
+        assert(capacity < (1ull << 32) - 2);
+        if(capacity != old_capacity) {
+            __aligned_free(index);
+            index = reinterpret_cast<uint32_t*>(__aligned_alloc(CACHE_LINE, capacity * 4));
+            entries =
+                reinterpret_cast<Entry*>(__aligned_alloc(CACHE_LINE, limit() * sizeof(Entry)));
+        }
+        // in place when the capacity stays, since live <= i
+        uint64_t live = 0;
+        for(uint64_t i = 0; i < used; i++) {
+            if(old_entries[i].key != ERASED) entries[live++] = old_entries[i];
+        }
+        used = live;
+        std::memset(index, 0xff, capacity * 4);
+        for(uint64_t i = 0; i < used; i++) place(static_cast<uint32_t>(i));
+        if(capacity != old_capacity) __aligned_free(old_entries);
+    }
+
+    void clear() {
+        size_ = used = 0;
+        std::memset(index, 0xff, capacity * 4);
+    }
+
+    uint64_t index_for(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t i = hash & (capacity - 1);
+        return i;
+    }
+    uint64_t prefetch(uint64_t key) {
+        uint64_t i = index_for(key);
+        ::prefetch(&index[i]);
+        return i;
+    }
+    uint64_t find_indexed(uint64_t key, uint64_t i, uint64_t* steps) {
+        for(;;) {
+            uint32_t pos = index[i];
+            if(pos != DELETED && entries[pos].key == key) return entries[pos].value;
+            (*steps)++;
+            i = (i + 1) & (capacity - 1);
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // one lookup for find_amac(): steps alternate between an index slot and its entry
+    struct Probe {
+        uint64_t key, index, value;
+        uint32_t pos;
+    };
+    void probe_start(Probe& p, uint64_t key) {
+        p.key = key;
+        p.index = prefetch(key);
+        p.pos = EMPTY;
+    }
+    bool probe_step(Probe& p) {
+        if(p.pos == EMPTY) {
+            p.pos = index[p.index];
+            if(p.pos != DELETED) {
+                ::prefetch(&entries[p.pos]);
+                return false;
+            }
+        } else if(entries[p.pos].key == p.key) {
+            p.value = entries[p.pos].value;
+            return true;
+        }
+        p.index = (p.index + 1) & (capacity - 1);
+        p.pos = EMPTY;
+        ::prefetch(&index[p.index]);
+        return false;
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() { return 4 * capacity + sizeof(Entry) * limit() + sizeof(Dense); }
+
+    // in insertion order; without erased entries in the way this is a branch-free scan
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        if(used == size_) {
+            for(uint64_t i = 0; i < used; i++) sum += entries[i].value;
+        } else {
+            for(uint64_t i = 0; i < used; i++) {
+                if(entries[i].key != ERASED) sum += entries[i].value;
+            }
+        }
+        return sum;
+    }
+
+    struct Entry {
+        uint64_t key, value;
+    };
+    uint32_t* index;
+    Entry* entries;
+    // entries in use, erased ones included
+    uint64_t used;
+    uint64_t capacity;
+    uint64_t size_;
+    double min_load;
+};
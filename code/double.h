@@ -1,22 +1,29 @@
 #pragma once
 
 #include "base.h"
+#include "bulk.h"
 
-template<uint64_t LF_, uint64_t DF_>
+template<uint64_t LF_, uint64_t DF_, typename Hash = Squirrel3_Hash>
 struct Double {
 
+    struct Slot;
+
     static constexpr uint64_t EMPTY = UINT64_MAX;
     static constexpr uint64_t DELETED = UINT64_MAX - 1;
     static constexpr double LF = static_cast<double>(LF_) / 100.0;
     static constexpr double DF = static_cast<double>(DF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
 
     Double() {
         size_ = 0;
         capacity = 8;
+        min_load = LF * SHRINK_LOAD;
         deleted_ = 0;
+        grow_threads = 1;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
     }
+    explicit Double(uint64_t n) : Double() { reserve(n); }
     ~Double() { __aligned_free(data); }
 
     uint64_t hash_to_step(uint64_t hash) {
@@ -27,7 +34,7 @@ struct Double {
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
         if(size_ >= capacity * LF) grow();
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         if(data[index].key < DELETED) {
             uint64_t step = hash_to_step(hash);
@@ -39,7 +46,7 @@ struct Double {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t step = hash_to_step(hash);
         for(;;) {
@@ -50,7 +57,7 @@ struct Double {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t step = hash_to_step(hash), dist = 0;
         while(data[index].key < EMPTY) {
@@ -63,7 +70,7 @@ struct Double {
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t step = hash_to_step(hash);
         for(;;) {
@@ -71,7 +78,10 @@ struct Double {
                 data[index].key = DELETED;
                 size_--;
                 deleted_++;
-                if(deleted_ >= capacity * DF) rehash();
+                if(size_ < capacity * min_load && capacity > 8)
+                    resize(capacity / 2);
+                else if(deleted_ >= capacity * DF)
+                    rehash();
                 return;
             }
             index = (index + step) & (capacity - 1);
@@ -80,30 +90,68 @@ struct Double {
 
     void rehash() {
         Slot* old_data = data;
-        size_ = 0;
         deleted_ = 0;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
-        for(uint64_t i = 0; i < capacity; i++) {
-            if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
-        }
+        move_from(old_data, capacity);
         __aligned_free(old_data);
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot* old_data = data;
-        size_ = 0;
-        capacity *= 2;
+        capacity = new_capacity;
         deleted_ = 0;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
-        for(uint64_t i = 0; i < old_capacity; i++) {
-            if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
-        }
+        move_from(old_data, old_capacity);
         __aligned_free(old_data);
     }
 
+    // reinserts the pairs from an old array into the freshly cleared one, with claim_fill() if
+    // grow_threads is set (see bulk.h); that path leaves size_ as it is
+    void move_from(Slot* old_data, uint64_t old_capacity) {
+        if(grow_threads == 1) {
+            size_ = 0;
+            for(uint64_t i = 0; i < old_capacity; i++) {
+                if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
+            }
+            return;
+        }
+        ::claim_fill(
+            old_capacity, grow_threads,
+            [old_data](uint64_t i, uint64_t& key, uint64_t& value) {
+                key = old_data[i].key;
+                value = old_data[i].value;
+                return key < DELETED;
+            },
+            [this](uint64_t key, uint64_t& step) {
+                uint64_t hash = Hash{}(key);
+                step = hash_to_step(hash);
+                return hash & (capacity - 1);
+            },
+            [this](uint64_t index, uint64_t step, uint64_t) {
+                return (index + step) & (capacity - 1);
+            },
+            [this](uint64_t index, uint64_t key, uint64_t value) {
+                if(!::claim(data[index].key, EMPTY, key)) return false;
+                data[index].value = value;
+                return true;
+            });
+    }
+
     void clear() {
         size_ = 0;
         deleted_ = 0;
@@ -111,11 +159,11 @@ struct Double {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         return hash;
     }
     uint64_t prefetch(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         ::prefetch(&data[index]);
         return hash;
@@ -130,6 +178,34 @@ struct Double {
         }
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // one lookup for find_amac(): each step checks one slot of the probe sequence
+    struct Probe {
+        uint64_t key, index, step, value;
+    };
+    void probe_start(Probe& p, uint64_t key) {
+        uint64_t hash = prefetch(key);
+        p.key = key;
+        p.index = hash & (capacity - 1);
+        p.step = hash_to_step(hash);
+    }
+    bool probe_step(Probe& p) {
+        if(data[p.index].key == p.key) {
+            p.value = data[p.index].value;
+            return true;
+        }
+        p.index = (p.index + p.step) & (capacity - 1);
+        ::prefetch(&data[p.index]);
+        return false;
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Double); }
@@ -149,4 +225,7 @@ struct Double {
     uint64_t capacity;
     uint64_t size_;
     uint64_t deleted_;
+    // threads grow() and rehash() move pairs with; 1 keeps the serial insert loop
+    uint64_t grow_threads;
+    double min_load;
 };
\ No newline at end of file
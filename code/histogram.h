@@ -0,0 +1,88 @@
+#pragma once
+
+#include <bit>
+#include <chrono>
+
+#include "base.h"
+
+// fenced so the timestamps don't drift into the operation being measured
+inline uint64_t rdtsc() {
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+// measured once against the system clock; assumes an invariant TSC
+inline double tsc_per_ns() {
+    static const double ratio = []() {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t t0 = rdtsc();
+        while(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {}
+        const uint64_t t1 = rdtsc();
+        const auto end = std::chrono::steady_clock::now();
+        return static_cast<double>(t1 - t0) /
+               static_cast<double>(
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    }();
+    return ratio;
+}
+
+// HDR-style histogram: values below 2 * SUB are exact, above that every power of two is split
+// into SUB linear buckets, so any recorded value is off by at most 1 / SUB.
+struct Histogram {
+
+    static constexpr uint64_t SUB_BITS = 5;
+    static constexpr uint64_t SUB = 1ull << SUB_BITS;
+    // 2 * SUB exact buckets, then SUB for each bit width from SUB_BITS + 2 up to 64, which a
+    // wrapped rdtsc() delta can reach
+    static constexpr uint64_t BUCKETS = (64 - SUB_BITS + 1) * SUB;
+
+    Histogram() { clear(); }
+
+    static uint64_t bucket_for(uint64_t value) {
+        if(value < 2 * SUB) return value;
+        uint64_t shift = std::bit_width(value) - SUB_BITS - 1;
+        return shift * SUB + (value >> shift);
+    }
+    // the largest value that lands in the bucket; for the last one the shift wraps to
+    // UINT64_MAX, as it should
+    static uint64_t highest_in(uint64_t bucket) {
+        if(bucket < 2 * SUB) return bucket;
+        uint64_t shift = bucket / SUB - 1;
+        return ((bucket % SUB + SUB + 1) << shift) - 1;
+    }
+
+    void record(uint64_t value) {
+        counts[bucket_for(value)]++;
+        total++;
+        max = std::max(max, value);
+    }
+
+    void merge(const Histogram& other) {
+        for(uint64_t i = 0; i < BUCKETS; i++) counts[i] += other.counts[i];
+        total += other.total;
+        max = std::max(max, other.max);
+    }
+
+    // p in [0, 1]
+    uint64_t percentile(double p) {
+        uint64_t target = static_cast<uint64_t>(p * static_cast<double>(total) + 0.5);
+        target = std::max(target, uint64_t{1});
+        uint64_t seen = 0;
+        for(uint64_t i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if(seen >= target) return std::min(highest_in(i), max);
+        }
+        return max;
+    }
+
+    void clear() {
+        std::memset(counts, 0, sizeof(counts));
+        total = max = 0;
+    }
+
+    uint64_t counts[BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
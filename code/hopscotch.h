@@ -0,0 +1,189 @@
+#pragma once
+
+#include "base.h"
+
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
+struct Hopscotch {
+
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    static constexpr uint64_t H = 64;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    // prefetch() touches two lines per key
+    static constexpr uint64_t BATCH = 8;
+
+    Hopscotch() {
+        size_ = 0;
+        capacity = H;
+        min_load = LF * SHRINK_LOAD;
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        hops =
+            reinterpret_cast<uint64_t*>(__aligned_alloc(CACHE_LINE, sizeof(uint64_t) * capacity));
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+        std::memset(hops, 0, sizeof(uint64_t) * capacity);
+    }
+    explicit Hopscotch(uint64_t n) : Hopscotch() { reserve(n); }
+    ~Hopscotch() {
+        __aligned_free(data);
+        __aligned_free(hops);
+    }
+
+    // assumes key is not in the map
+    void insert(uint64_t key, uint64_t value) {
+        if(size_ >= capacity * LF) grow();
+        uint64_t hash = Hash{}(key);
+        uint64_t home = hash & (capacity - 1);
+        uint64_t dist = 0;
+        while(data[(home + dist) & (capacity - 1)].key != EMPTY) dist++;
+        uint64_t free = (home + dist) & (capacity - 1);
+        // hop the free slot back towards home until it lands in the neighborhood
+        while(dist >= H) {
+            bool moved = false;
+            for(uint64_t back = H - 1; back > 0 && !moved; back--) {
+                uint64_t bucket = (free - back) & (capacity - 1);
+                uint64_t bits = hops[bucket] & ((1ull << back) - 1);
+                if(!bits) continue;
+                uint64_t offset = __ctz64(bits);
+                uint64_t from = (bucket + offset) & (capacity - 1);
+                data[free] = data[from];
+                data[from].key = EMPTY;
+                hops[bucket] = (hops[bucket] & ~(1ull << offset)) | (1ull << back);
+                dist -= back - offset;
+                free = from;
+                moved = true;
+            }
+            if(!moved) {
+                grow();
+                insert(key, value);
+                return;
+            }
+        }
+        data[free].key = key;
+        data[free].value = value;
+        hops[home] |= 1ull << dist;
+        size_++;
+    }
+
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        return find_indexed(key, index, steps);
+    }
+
+    bool contains(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t home = hash & (capacity - 1);
+        uint64_t bits = hops[home];
+        while(bits) {
+            uint64_t index = (home + __ctz64(bits)) & (capacity - 1);
+            if(data[index].key == key) return true;
+            (*steps)++;
+            bits &= bits - 1;
+        }
+        return false;
+    }
+
+    void erase(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t home = hash & (capacity - 1);
+        uint64_t bits = hops[home];
+        for(;;) {
+            uint64_t offset = __ctz64(bits);
+            uint64_t index = (home + offset) & (capacity - 1);
+            if(data[index].key == key) {
+                data[index].key = EMPTY;
+                hops[home] &= ~(1ull << offset);
+                size_--;
+                if(size_ < capacity * min_load && capacity > H) resize(capacity / 2);
+                return;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF, H);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF, H);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
+        uint64_t old_capacity = capacity;
+        Slot* old_data = data;
+        size_ = 0;
+        capacity = new_capacity;
+        __aligned_free(hops);
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        hops =
+            reinterpret_cast<uint64_t*>(__aligned_alloc(CACHE_LINE, sizeof(uint64_t) * capacity));
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+        std::memset(hops, 0, sizeof(uint64_t) * capacity);
+        for(uint64_t i = 0; i < old_capacity; i++) {
+            if(old_data[i].key != EMPTY) insert(old_data[i].key, old_data[i].value);
+        }
+        __aligned_free(old_data);
+    }
+
+    void clear() {
+        size_ = 0;
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+        std::memset(hops, 0, sizeof(uint64_t) * capacity);
+    }
+
+    uint64_t index_for(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        return index;
+    }
+    uint64_t prefetch(uint64_t key) {
+        uint64_t index = index_for(key);
+        ::prefetch(&hops[index]);
+        ::prefetch(&data[index]);
+        return index;
+    }
+    uint64_t find_indexed(uint64_t key, uint64_t home, uint64_t* steps) {
+        uint64_t bits = hops[home];
+        for(;;) {
+            uint64_t index = (home + __ctz64(bits)) & (capacity - 1);
+            if(data[index].key == key) return data[index].value;
+            (*steps)++;
+            bits &= bits - 1;
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() {
+        return (sizeof(Slot) + sizeof(uint64_t)) * capacity + sizeof(Hopscotch);
+    }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < capacity; i++) {
+            if(data[i].key != EMPTY) sum += data[i].value;
+        }
+        return sum;
+    }
+
+    struct Slot {
+        uint64_t key, value;
+    };
+    Slot* data;
+    uint64_t* hops;
+    uint64_t capacity;
+    uint64_t size_;
+    double min_load;
+};
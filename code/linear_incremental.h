@@ -0,0 +1,187 @@
+#pragma once
+
+#include "base.h"
+
+// Linear probing that spreads grow() over later operations: the old array stays alive and
+// every insert/erase moves up to STEP of its slots into the new one. Lookups check the new
+// array first, then whatever has not been migrated yet.
+template<uint64_t LF_, uint64_t STEP, typename Hash = Squirrel3_Hash>
+struct Linear_Incremental {
+
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    static constexpr uint64_t DELETED = UINT64_MAX - 1;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
+
+    struct Slot;
+
+    Linear_Incremental() {
+        size_ = 0;
+        capacity = 8;
+        min_load = LF * SHRINK_LOAD;
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+        old_data = nullptr;
+        old_capacity = migrated = 0;
+    }
+    explicit Linear_Incremental(uint64_t n) : Linear_Incremental() { reserve(n); }
+    ~Linear_Incremental() {
+        __aligned_free(data);
+        if(old_data) __aligned_free(old_data);
+    }
+
+    // assumes key is not in the map
+    void insert(uint64_t key, uint64_t value) {
+        if(size_ >= capacity * LF) grow();
+        if(old_data) migrate();
+        place(key, value);
+        size_++;
+    }
+
+    void place(uint64_t key, uint64_t value) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        while(data[index].key < DELETED) { index = (index + 1) & (capacity - 1); }
+        data[index].key = key;
+        data[index].value = value;
+    }
+
+    // returns the slot holding key, or nullptr
+    static Slot* lookup(Slot* slots, uint64_t cap, uint64_t index, uint64_t key,
+                        uint64_t* steps) {
+        uint64_t dist = 0;
+        while(slots[index].key < EMPTY) {
+            if(dist++ == cap) return nullptr;
+            if(slots[index].key == key) return &slots[index];
+            (*steps)++;
+            index = (index + 1) & (cap - 1);
+        }
+        return nullptr;
+    }
+    Slot* lookup(uint64_t key, uint64_t index, uint64_t* steps) {
+        Slot* s = lookup(data, capacity, index, key, steps);
+        if(s || !old_data) return s;
+        uint64_t hash = Hash{}(key);
+        return lookup(old_data, old_capacity, hash & (old_capacity - 1), key, steps);
+    }
+
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        return lookup(key, hash & (capacity - 1), steps)->value;
+    }
+
+    bool contains(uint64_t key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        return lookup(key, hash & (capacity - 1), steps) != nullptr;
+    }
+
+    void erase(uint64_t key) {
+        if(old_data) migrate();
+        uint64_t hash = Hash{}(key), steps = 0;
+        lookup(key, hash & (capacity - 1), &steps)->key = DELETED;
+        size_--;
+        if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
+    }
+
+    // move the next STEP old slots, leaving tombstones so unmigrated probe chains stay intact
+    void migrate() {
+        uint64_t end = std::min(migrated + STEP, old_capacity);
+        for(; migrated < end; migrated++) {
+            if(old_data[migrated].key < DELETED) {
+                place(old_data[migrated].key, old_data[migrated].value);
+                old_data[migrated].key = DELETED;
+            }
+        }
+        if(migrated == old_capacity) {
+            __aligned_free(old_data);
+            old_data = nullptr;
+        }
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    // unlike a shrink from erase(), the move is finished right away
+    void shrink_to_fit() {
+        while(old_data) migrate();
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+        while(old_data) migrate();
+    }
+
+    // with the move finished right away
+    void reserve(uint64_t n) {
+        while(old_data) migrate();
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+        while(old_data) migrate();
+    }
+
+    void resize(uint64_t new_capacity) {
+        // a grow during migration has to finish the previous one first
+        while(old_data) migrate();
+        old_capacity = capacity;
+        old_data = data;
+        migrated = 0;
+        capacity = new_capacity;
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+    }
+
+    void clear() {
+        size_ = 0;
+        if(old_data) __aligned_free(old_data);
+        old_data = nullptr;
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+    }
+
+    uint64_t index_for(uint64_t key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        return index;
+    }
+    uint64_t prefetch(uint64_t key) {
+        uint64_t index = index_for(key);
+        ::prefetch(&data[index]);
+        return index;
+    }
+    uint64_t find_indexed(uint64_t key, uint64_t index, uint64_t* steps) {
+        return lookup(key, index, steps)->value;
+    }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() {
+        return sizeof(Slot) * (capacity + (old_data ? old_capacity : 0)) +
+               sizeof(Linear_Incremental);
+    }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < capacity; i++) {
+            if(data[i].key < DELETED) sum += data[i].value;
+        }
+        for(uint64_t i = migrated; old_data && i < old_capacity; i++) {
+            if(old_data[i].key < DELETED) sum += old_data[i].value;
+        }
+        return sum;
+    }
+
+    struct Slot {
+        uint64_t key, value;
+    };
+    Slot* data;
+    Slot* old_data;
+    uint64_t capacity;
+    uint64_t old_capacity;
+    uint64_t migrated;
+    uint64_t size_;
+    double min_load;
+};
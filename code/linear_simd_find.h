@@ -1,32 +1,37 @@
 #pragma once
 
 #include "base.h"
+#include "bulk.h"
+#include "snapshot.h"
 
-template<uint64_t LF_>
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
 struct Linear_SIMD {
 
     static constexpr uint64_t EMPTY = UINT64_MAX;
     static constexpr uint64_t DELETED = UINT64_MAX - 1;
     static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    // prefetch() touches two lines per key
+    static constexpr uint64_t BATCH = 8;
 
     Linear_SIMD() {
         size_ = 0;
         capacity = 8;
+        min_load = LF * SHRINK_LOAD;
+        mapped = nullptr;
+        mapped_bytes = 0;
         keys =
             reinterpret_cast<uint64_t*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(uint64_t)));
         values =
             reinterpret_cast<uint64_t*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(uint64_t)));
         std::memset(keys, 0xff, sizeof(uint64_t) * capacity);
     }
-    ~Linear_SIMD() {
-        __aligned_free(keys);
-        __aligned_free(values);
-    }
+    explicit Linear_SIMD(uint64_t n) : Linear_SIMD() { reserve(n); }
+    ~Linear_SIMD() { release(keys, values, capacity); }
 
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
         if(size_ >= capacity * LF) grow();
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         while(keys[index] < DELETED) { index = (index + 1) & (capacity - 1); }
         keys[index] = key;
@@ -35,7 +40,7 @@ struct Linear_SIMD {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1) & ~3;
         __m256i key256 = _mm256_set1_epi64x(key);
         for(;;) {
@@ -52,7 +57,7 @@ struct Linear_SIMD {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t dist = 0;
         while(keys[index] < EMPTY) {
@@ -65,24 +70,37 @@ struct Linear_SIMD {
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         for(;;) {
             if(keys[index] == key) {
                 keys[index] = DELETED;
                 size_--;
+                if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
                 return;
             }
             index = (index + 1) & (capacity - 1);
         }
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         uint64_t* old_keys = keys;
         uint64_t* old_values = values;
         size_ = 0;
-        capacity *= 2;
+        capacity = new_capacity;
         keys =
             reinterpret_cast<uint64_t*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(uint64_t)));
         values =
@@ -91,8 +109,33 @@ struct Linear_SIMD {
         for(uint64_t i = 0; i < old_capacity; i++) {
             if(old_keys[i] < DELETED) insert(old_keys[i], old_values[i]);
         }
-        __aligned_free(old_keys);
-        __aligned_free(old_values);
+        release(old_keys, old_values, old_capacity);
+    }
+
+    // replaces the contents with n distinct keys: sizes the table once, then fills it from
+    // several threads (see bulk.h)
+    void bulk_build(const uint64_t* new_keys, const uint64_t* new_values, uint64_t n) {
+        release(keys, values, capacity);
+        capacity = capacity_for(n, LF);
+        keys =
+            reinterpret_cast<uint64_t*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(uint64_t)));
+        values =
+            reinterpret_cast<uint64_t*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(uint64_t)));
+        std::memset(keys, 0xff, sizeof(uint64_t) * capacity);
+        Bulk_Result result = ::bulk_fill(
+            n, capacity, hardware_threads(),
+            [new_keys, new_values](uint64_t i, uint64_t& key, uint64_t& value) {
+                key = new_keys[i];
+                value = new_values[i];
+                return true;
+            },
+            [this](uint64_t key) { return Hash{}(key) & (capacity - 1); },
+            [this](uint64_t index, uint64_t key, uint64_t value) {
+                keys[index] = key;
+                values[index] = value;
+            });
+        size_ = result.placed;
+        for(auto [key, value] : result.overflow) insert(key, value);
     }
 
     void clear() {
@@ -101,7 +144,7 @@ struct Linear_SIMD {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1) & ~3;
         return index;
     }
@@ -129,6 +172,42 @@ struct Linear_SIMD {
         }
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // see snapshot.h; a loaded table reads from the mapping until it next grows
+    bool save(const char* path) {
+        const void* arrays[] = {keys, values};
+        return Snapshot::save<Hash>(path, "linear_simd", capacity, size_, 0, arrays,
+                                    {sizeof(uint64_t), sizeof(uint64_t)});
+    }
+    bool load_mmap(const char* path) {
+        Snapshot::Header header;
+        uint64_t length = 0;
+        void* base = Snapshot::map<Hash>(path, "linear_simd", {sizeof(uint64_t), sizeof(uint64_t)},
+                                         header, length);
+        if(!base) return false;
+        release(keys, values, capacity);
+        mapped = base;
+        mapped_bytes = length;
+        keys = Snapshot::array<uint64_t>(base, header, 0);
+        values = Snapshot::array<uint64_t>(base, header, 1);
+        capacity = header.capacity;
+        size_ = header.size;
+        return true;
+    }
+    // keys and values either both live in the snapshot or both came from the allocator
+    void release(void* old_keys, void* old_values, uint64_t old_capacity) {
+        uint64_t bytes = sizeof(uint64_t) * old_capacity;
+        if(!Snapshot::owns(mapped, mapped_bytes, old_keys)) Aligned_Alloc::free(old_values, bytes);
+        Snapshot::release<Aligned_Alloc>(mapped, mapped_bytes, old_keys, bytes);
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return 2 * sizeof(uint64_t) * capacity + sizeof(Linear_SIMD); }
@@ -145,4 +224,8 @@ struct Linear_SIMD {
     uint64_t* values;
     uint64_t capacity;
     uint64_t size_;
+    // the snapshot the arrays live in, if loaded with load_mmap()
+    void* mapped;
+    uint64_t mapped_bytes;
+    double min_load;
 };
\ No newline at end of file
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <string_view>
+
+#include "base.h"
+
+// Linear probing over string keys, split like Linear_SIMD: a 16 byte head per slot with a
+// 32-bit hash, the length and the first 8 bytes of the key, and a separate array with the
+// value and where the rest of the key lives in an append-only arena. One AVX2 compare checks
+// two heads, so a mismatch almost never leaves the head array, and keys of up to 8 bytes never
+// touch the arena at all. grow() rehashes from the cached hashes. Erased keys leave their bytes
+// behind until a grow() finds more dead bytes than live ones, or clear() drops the whole arena.
+template<uint64_t LF_, typename Hash = String_Hash>
+struct Linear_String {
+
+    struct Head;
+
+    // sentinels live in the length, so the key bytes are unrestricted
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    static constexpr uint32_t DELETED = UINT32_MAX - 1;
+    static constexpr uint64_t PREFIX = 8;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    // prefetch() touches two lines per key; a key longer than PREFIX adds an arena line that
+    // can't be prefetched, since its offset is in the entry, so it stays a dependent miss
+    static constexpr uint64_t BATCH = 8;
+
+    Linear_String() {
+        size_ = 0;
+        capacity = 8;
+        min_load = LF * SHRINK_LOAD;
+        heads = reinterpret_cast<Head*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(Head)));
+        entries = reinterpret_cast<Entry*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(Entry)));
+        std::memset(heads, 0xff, sizeof(Head) * capacity);
+        arena = nullptr;
+        arena_size = arena_capacity = dead = 0;
+    }
+    explicit Linear_String(uint64_t n) : Linear_String() { reserve(n); }
+    ~Linear_String() {
+        __aligned_free(heads);
+        __aligned_free(entries);
+        std::free(arena);
+    }
+
+    static Head head_for(std::string_view key, uint64_t hash) {
+        assert(key.size() < DELETED);
+        Head head;
+        head.hash = static_cast<uint32_t>(hash);
+        head.length = static_cast<uint32_t>(key.size());
+        head.prefix = 0;
+        std::memcpy(&head.prefix, key.data(), std::min<uint64_t>(key.size(), PREFIX));
+        return head;
+    }
+
+    // heads that match in full only differ in the bytes past the prefix
+    bool tail_equals(uint64_t index, std::string_view key) {
+        if(key.size() <= PREFIX) return true;
+        return std::memcmp(arena + entries[index].offset, key.data() + PREFIX,
+                           key.size() - PREFIX) == 0;
+    }
+
+    // bit 0 if the head at index matches, bit 1 for the one after it
+    uint32_t match(uint64_t index, const Head& head) {
+        __m256i test = _mm256_load_si256(reinterpret_cast<__m256i*>(&heads[index]));
+        __m256i expected = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(&head)));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi64(test, expected));
+        return ((mask & 0xffff) == 0xffff) | ((mask >> 16) == 0xffff) << 1;
+    }
+
+    uint64_t append(std::string_view key) {
+        uint64_t length = key.size() - PREFIX;
+        if(arena_size + length > arena_capacity) {
+            arena_capacity = std::max(2 * arena_capacity, arena_size + length);
+            arena = reinterpret_cast<char*>(std::realloc(arena, arena_capacity));
+            assert(arena != nullptr);
+        }
+        std::memcpy(arena + arena_size, key.data() + PREFIX, length);
+        arena_size += length;
+        return arena_size - length;
+    }
+
+    // assumes key is not in the map
+    void insert(std::string_view key, uint64_t value) {
+        if(size_ >= capacity * LF) grow();
+        Head head = head_for(key, Hash{}(key));
+        uint64_t index = head.hash & (capacity - 1);
+        while(heads[index].length < DELETED) { index = (index + 1) & (capacity - 1); }
+        heads[index] = head;
+        entries[index].offset = key.size() > PREFIX ? append(key) : 0;
+        entries[index].value = value;
+        size_++;
+    }
+
+    uint64_t find(std::string_view key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        return find_indexed(key, hash, steps);
+    }
+
+    bool contains(std::string_view key, uint64_t* steps) {
+        Head head = head_for(key, Hash{}(key));
+        uint64_t home = head.hash & (capacity - 1);
+        uint64_t index = home & ~1;
+        for(uint64_t dist = 0; dist < capacity; dist += 2) {
+            uint32_t mask = match(index, head);
+            while(mask) {
+                uint64_t i = index + __ctz(mask);
+                if(tail_equals(i, key)) return true;
+                mask &= mask - 1;
+            }
+            // the slot before an odd home is not part of the probe
+            if(heads[index + 1].length == EMPTY) return false;
+            if(heads[index].length == EMPTY && index != home - 1) return false;
+            *steps += 2;
+            index = (index + 2) & (capacity - 1);
+        }
+        return false;
+    }
+
+    void erase(std::string_view key) {
+        Head head = head_for(key, Hash{}(key));
+        uint64_t index = head.hash & (capacity - 1) & ~1;
+        for(;;) {
+            uint32_t mask = match(index, head);
+            while(mask) {
+                uint64_t i = index + __ctz(mask);
+                if(tail_equals(i, key)) {
+                    if(key.size() > PREFIX) dead += key.size() - PREFIX;
+                    heads[i].length = DELETED;
+                    size_--;
+                    if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
+                    return;
+                }
+                mask &= mask - 1;
+            }
+            index = (index + 2) & (capacity - 1);
+        }
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    // also compacts the arena if it has dead bytes
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+        if(dead) compact();
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
+        uint64_t old_capacity = capacity;
+        Head* old_heads = heads;
+        Entry* old_entries = entries;
+        capacity = new_capacity;
+        // the cached hash only has 32 bits to index with
+        assert(capacity <= (1ull << 32));
+        heads = reinterpret_cast<Head*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(Head)));
+        entries = reinterpret_cast<Entry*>(__aligned_alloc(CACHE_LINE, capacity * sizeof(Entry)));
+        std::memset(heads, 0xff, sizeof(Head) * capacity);
+        for(uint64_t i = 0; i < old_capacity; i++) {
+            if(old_heads[i].length >= DELETED) continue;
+            uint64_t index = old_heads[i].hash & (capacity - 1);
+            while(heads[index].length != EMPTY) { index = (index + 1) & (capacity - 1); }
+            heads[index] = old_heads[i];
+            entries[index] = old_entries[i];
+        }
+        __aligned_free(old_heads);
+        __aligned_free(old_entries);
+        if(dead > arena_size - dead) compact();
+    }
+
+    // copies the live key bytes into a fresh arena
+    void compact() {
+        char* old_arena = arena;
+        arena_capacity = arena_size - dead;
+        arena = reinterpret_cast<char*>(std::malloc(std::max<uint64_t>(arena_capacity, 1)));
+        arena_size = dead = 0;
+        for(uint64_t i = 0; i < capacity; i++) {
+            if(heads[i].length >= DELETED || heads[i].length <= PREFIX) continue;
+            uint64_t length = heads[i].length - PREFIX;
+            std::memcpy(arena + arena_size, old_arena + entries[i].offset, length);
+            entries[i].offset = arena_size;
+            arena_size += length;
+        }
+        std::free(old_arena);
+    }
+
+    void clear() {
+        size_ = 0;
+        std::memset(heads, 0xff, sizeof(Head) * capacity);
+        std::free(arena);
+        arena = nullptr;
+        arena_size = arena_capacity = dead = 0;
+    }
+
+    uint64_t index_for(std::string_view key) {
+        uint64_t hash = Hash{}(key);
+        return hash;
+    }
+    uint64_t prefetch(std::string_view key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = static_cast<uint32_t>(hash) & (capacity - 1) & ~1;
+        ::prefetch(&heads[index]);
+        ::prefetch(&entries[index]);
+        return hash;
+    }
+    uint64_t find_indexed(std::string_view key, uint64_t hash, uint64_t* steps) {
+        Head head = head_for(key, hash);
+        uint64_t index = head.hash & (capacity - 1) & ~1;
+        for(;;) {
+            uint32_t mask = match(index, head);
+            while(mask) {
+                uint64_t i = index + __ctz(mask);
+                if(tail_equals(i, key)) return entries[i].value;
+                mask &= mask - 1;
+            }
+            *steps += 2;
+            index = (index + 2) & (capacity - 1);
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const std::string_view* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const std::string_view* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() {
+        return (sizeof(Head) + sizeof(Entry)) * capacity + arena_capacity + sizeof(Linear_String);
+    }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < capacity; i++) {
+            if(heads[i].length < DELETED) sum += entries[i].value;
+        }
+        return sum;
+    }
+
+    struct Head {
+        uint32_t hash;
+        uint32_t length;
+        uint64_t prefix;
+    };
+    struct Entry {
+        uint64_t offset, value;
+    };
+    Head* heads;
+    Entry* entries;
+    char* arena;
+    uint64_t arena_size;
+    uint64_t arena_capacity;
+    // bytes in the arena that belong to erased keys
+    uint64_t dead;
+    uint64_t capacity;
+    uint64_t size_;
+    double min_load;
+};
@@ -2,24 +2,27 @@
 
 #include "base.h"
 
-template<uint64_t LF_>
+template<uint64_t LF_, typename Hash = Squirrel3_Hash>
 struct Linear_With_Deletion {
 
     static constexpr uint64_t EMPTY = UINT64_MAX;
     static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
 
     Linear_With_Deletion() {
         size_ = 0;
         capacity = 8;
+        min_load = LF * SHRINK_LOAD;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
     }
+    explicit Linear_With_Deletion(uint64_t n) : Linear_With_Deletion() { reserve(n); }
     ~Linear_With_Deletion() { __aligned_free(data); }
 
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
         if(size_ >= capacity * LF) grow();
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         while(data[index].key < EMPTY) { index = (index + 1) & (capacity - 1); }
         data[index].key = key;
@@ -28,7 +31,7 @@ struct Linear_With_Deletion {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         for(;;) {
             if(data[index].key == key) return data[index].value;
@@ -38,7 +41,7 @@ struct Linear_With_Deletion {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t dist = 0;
         while(data[index].key < EMPTY) {
@@ -63,24 +66,37 @@ struct Linear_With_Deletion {
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         for(;;) {
             if(data[index].key == key) {
                 data[index].key = EMPTY;
                 size_--;
                 fix_up(index);
+                if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
                 return;
             }
             index = (index + 1) & (capacity - 1);
         }
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot* old_data = data;
         size_ = 0;
-        capacity *= 2;
+        capacity = new_capacity;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
         for(uint64_t i = 0; i < old_capacity; i++) {
@@ -95,7 +111,7 @@ struct Linear_With_Deletion {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         return index;
     }
@@ -112,6 +128,14 @@ struct Linear_With_Deletion {
         }
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Linear_With_Deletion); }
@@ -130,4 +154,5 @@ struct Linear_With_Deletion {
     Slot* data;
     uint64_t capacity;
     uint64_t size_;
+    double min_load;
 };
\ No newline at end of file
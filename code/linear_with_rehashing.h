@@ -1,27 +1,34 @@
 #pragma once
 
 #include "base.h"
+#include "bulk.h"
 
-template<uint64_t LF_, uint64_t DF_>
+template<uint64_t LF_, uint64_t DF_, typename Hash = Squirrel3_Hash>
 struct Linear_With_Rehash {
 
+    struct Slot;
+
     static constexpr uint64_t EMPTY = UINT64_MAX;
     static constexpr uint64_t DELETED = UINT64_MAX - 1;
     static constexpr double LF = static_cast<double>(LF_) / 100.0;
     static constexpr double DF = static_cast<double>(DF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
 
     Linear_With_Rehash() {
         size_ = deleted_ = 0;
         capacity = 8;
+        min_load = LF * SHRINK_LOAD;
+        grow_threads = 1;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
     }
+    explicit Linear_With_Rehash(uint64_t n) : Linear_With_Rehash() { reserve(n); }
     ~Linear_With_Rehash() { __aligned_free(data); }
 
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
         if(size_ >= capacity * LF) grow();
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         while(data[index].key < DELETED) { index = (index + 1) & (capacity - 1); }
         data[index].key = key;
@@ -30,7 +37,7 @@ struct Linear_With_Rehash {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         for(;;) {
             if(data[index].key == key) return data[index].value;
@@ -40,7 +47,7 @@ struct Linear_With_Rehash {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t dist = 0;
         while(data[index].key < EMPTY) {
@@ -54,18 +61,15 @@ struct Linear_With_Rehash {
 
     void rehash() {
         Slot* old_data = data;
-        size_ = 0;
         deleted_ = 0;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
-        for(uint64_t i = 0; i < capacity; i++) {
-            if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
-        }
+        move_from(old_data, capacity);
         __aligned_free(old_data);
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         for(;;) {
             if(data[index].key == key) {
@@ -74,27 +78,65 @@ struct Linear_With_Rehash {
                 // This causes an msvc internal compiler error, very cool
                 // if(deleted_++ >= capacity * DF) rehash();
                 deleted_++;
-                if(deleted_ >= capacity * DF) rehash();
+                if(size_ < capacity * min_load && capacity > 8)
+                    resize(capacity / 2);
+                else if(deleted_ >= capacity * DF)
+                    rehash();
                 return;
             }
             index = (index + 1) & (capacity - 1);
         }
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot* old_data = data;
-        size_ = 0;
-        capacity *= 2;
+        capacity = new_capacity;
         deleted_ = 0;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
-        for(uint64_t i = 0; i < old_capacity; i++) {
-            if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
-        }
+        move_from(old_data, old_capacity);
         __aligned_free(old_data);
     }
 
+    // reinserts the pairs from an old array into the freshly cleared one; with grow_threads
+    // the layout is built per region (see bulk.h)
+    void move_from(Slot* old_data, uint64_t old_capacity) {
+        if(grow_threads == 1) {
+            size_ = 0;
+            for(uint64_t i = 0; i < old_capacity; i++) {
+                if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
+            }
+            return;
+        }
+        Bulk_Result result = ::bulk_fill(
+            old_capacity, capacity, grow_threads,
+            [old_data](uint64_t i, uint64_t& key, uint64_t& value) {
+                key = old_data[i].key;
+                value = old_data[i].value;
+                return key < DELETED;
+            },
+            [this](uint64_t key) { return index_for(key); },
+            [this](uint64_t index, uint64_t key, uint64_t value) {
+                data[index].key = key;
+                data[index].value = value;
+            });
+        size_ = result.placed;
+        for(auto [key, value] : result.overflow) insert(key, value);
+    }
+
     void clear() {
         size_ = 0;
         deleted_ = 0;
@@ -102,7 +144,7 @@ struct Linear_With_Rehash {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         return index;
     }
@@ -119,6 +161,14 @@ struct Linear_With_Rehash {
         }
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Linear_With_Rehash); }
@@ -138,4 +188,7 @@ struct Linear_With_Rehash {
     uint64_t capacity;
     uint64_t size_;
     uint64_t deleted_;
+    // threads grow() and rehash() move pairs with; 1 keeps the serial insert loop
+    uint64_t grow_threads;
+    double min_load;
 };
\ No newline at end of file
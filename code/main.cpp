@@ -1,26 +1,45 @@
 
 #include <array>
+#include <bit>
 #include <chrono>
 #include <concepts>
 #include <cstdint>
+#include <cstdio>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <random>
+#include <thread>
 #include <unordered_map>
 
+#include "amac.h"
 #include "base.h"
 #include "chaining.h"
+#include "chaining_unrolled.h"
+#include "concurrent_linear.h"
+#include "counters.h"
+#include "cuckoo.h"
+#include "dense.h"
 #include "double.h"
+#include "histogram.h"
+#include "hopscotch.h"
 #include "linear.h"
+#include "linear_incremental.h"
 #include "linear_simd_find.h"
+#include "linear_string.h"
 #include "linear_with_deletion.h"
 #include "linear_with_rehashing.h"
+#include "perfect.h"
 #include "quadratic.h"
 #include "robin_hood.h"
+#include "robin_hood_incremental.h"
 #include "robin_hood_with_deletion.h"
 #include "robin_hood_with_desired.h"
+#include "robin_hood_with_metadata.h"
+#include "sharded.h"
+#include "snapshot.h"
+#include "swiss.h"
 #include "two_way.h"
 #include "two_way_simd.h"
 
@@ -28,12 +47,20 @@ constexpr uint64_t CAPACITY = 1024 * 1024 * 8;
 // constexpr uint64_t CAPACITY = 5000000;
 // constexpr uint64_t CAPACITY = 1000;
 // constexpr uint64_t CAPACITY = 10;
+// keys per find_batch()/contains_batch() call in throughput()
+constexpr uint64_t BATCH = 256;
+// lookups find_amac() keeps in flight
+constexpr uint64_t AMAC_WIDTH = 16;
 constexpr bool CSV = true;
 // constexpr bool CSV = false;
+// times every operation individually in a separate pass; adds tail latency columns
+constexpr bool LATENCY = false;
+// constexpr bool LATENCY = true;
 
 template<typename T>
 concept Hashtable =
-    requires(T map, uint64_t key, uint64_t value, uint64_t prefetched, uint64_t* probes) {
+    requires(T map, uint64_t key, uint64_t value, uint64_t prefetched, uint64_t* probes,
+             const uint64_t* keys, size_t n, uint64_t* values, bool* found) {
         // may assume key is not in the map
         { map.insert(key, value) } -> std::same_as<void>;
         // may assume key is in the map
@@ -50,21 +77,34 @@ concept Hashtable =
         // may assume key is in the map
         { map.find_indexed(key, prefetched, probes) } -> std::same_as<uint64_t>;
 
+        // may assume all keys are in the map
+        { map.find_batch(keys, n, values) } -> std::same_as<void>;
+        { map.contains_batch(keys, n, found) } -> std::same_as<void>;
+
         { map.clear() } -> std::same_as<void>;
+        { map.shrink_to_fit() } -> std::same_as<void>;
+        { map.reserve(n) } -> std::same_as<void>;
+        // the same as reserve(n) on an empty map
+        T(n);
         { map.memory_usage() } -> std::same_as<uint64_t>;
         { map.size() } -> std::same_as<uint64_t>;
     };
 
-template<typename T>
+template<typename T, typename K = uint64_t, typename V = uint64_t>
 struct Std_Map_ {
 
-    void insert(uint64_t key, uint64_t value) { map.insert({key, value}); }
-    uint64_t find(uint64_t key, uint64_t*) { return map.find(key)->second; }
-    void erase(uint64_t key) { assert(map.erase(key) > 0); }
+    Std_Map_() = default;
+    explicit Std_Map_(uint64_t n) { reserve(n); }
+
+    void insert(K key, V value) { map.insert({std::move(key), std::move(value)}); }
+    V find(const K& key, uint64_t*) { return map.find(key)->second; }
+    void erase(const K& key) { assert(map.erase(key) > 0); }
     void clear() { map.clear(); }
+    void shrink_to_fit() { map.rehash(0); }
+    void reserve(uint64_t n) { map.reserve(n); }
     uint64_t memory_usage() { return 0; }
     uint64_t size() { return map.size(); }
-    bool contains(uint64_t key, uint64_t*) { return map.contains(key); }
+    bool contains(const K& key, uint64_t*) { return map.contains(key); }
 
     uint64_t sum_all_values() {
         uint64_t sum = 0;
@@ -72,30 +112,30 @@ struct Std_Map_ {
         return sum;
     }
 
-    uint64_t prefetch(uint64_t) { return 0; }
-    uint64_t index_for(uint64_t) { return 0; }
-    uint64_t find_indexed(uint64_t key, uint64_t, uint64_t* probes) {
-        return map.find(key)->second;
+    uint64_t prefetch(const K&) { return 0; }
+    uint64_t index_for(const K&) { return 0; }
+    V find_indexed(const K& key, uint64_t, uint64_t* probes) { return map.find(key)->second; }
+    void find_batch(const K* keys, size_t n, V* out) { ::find_batch<16>(*this, keys, n, out); }
+    void contains_batch(const K* keys, size_t n, bool* out) {
+        ::contains_batch<16>(*this, keys, n, out);
     }
 
-    std::unordered_map<uint64_t, uint64_t, T> map;
+    std::unordered_map<K, V, T> map;
 };
 using Std_Map = Std_Map_<std::hash<uint64_t>>;
 
-struct Squirrel3_Hash {
-    uint64_t operator()(uint64_t key) const { return squirrel3(key); }
-};
 using Std_Map_Squirrel3 = Std_Map_<Squirrel3_Hash>;
 
 template<Hashtable Map, uint64_t LF, uint64_t UNROLL>
-auto throughput() -> std::unordered_map<std::string, uint64_t> {
+auto throughput(uint64_t capacity) -> std::unordered_map<std::string, uint64_t> {
     Map map;
     std::unordered_map<std::string, uint64_t> results;
+    Perf_Counters counters;
 
     std::mt19937 rng{};
 
-    constexpr uint64_t N =
-        static_cast<uint64_t>(static_cast<double>(CAPACITY) * static_cast<double>(LF) / 100.0) - 1;
+    const uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(capacity) * static_cast<double>(LF) / 100.0) - 1;
 
     // make satollo cycle
     std::vector<uint64_t> next(N);
@@ -107,22 +147,46 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
         }
     }
 
+    // the batched lookups take their keys from an array, as a caller with a batch would
+    std::vector<uint64_t> keys(N);
+    for(uint64_t i = 0; i < N; ++i) { keys[i] = i; }
+
     {
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         for(uint64_t i = 0; i < N; ++i) { map.insert(i, next[i]); }
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["insert_1"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "insert_1");
         results["insert_1_memory"] = map.memory_usage();
     }
     assert(map.size() == N);
 
+    // the same inserts into a map sized for them up front, so the gap to insert_1 is growing
+    {
+        counters.start();
+        const auto start = std::chrono::high_resolution_clock::now();
+        Map reserved(N);
+        for(uint64_t i = 0; i < N; ++i) { reserved.insert(i, next[i]); }
+        const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
+
+        results["insert_reserved"] =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "insert_reserved");
+        results["insert_reserved_memory"] = reserved.memory_usage();
+        assert(reserved.size() == N);
+    }
+
     // traverse full cycle (cannot use ILP)
     {
         uint64_t n = 0;
         uint64_t total_probe_length = 0, max_probe_length = 0;
 
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         for(uint64_t i = 0; i < N; ++i) {
             uint64_t probe_length = 0;
@@ -131,10 +195,12 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
             max_probe_length = std::max(max_probe_length, probe_length);
         }
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         assert(n == 0);
         results["find_satollo"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_satollo");
         results["find_satollo_probes"] = total_probe_length;
         results["find_satollo_max_probes"] = max_probe_length;
     }
@@ -144,6 +210,7 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
     {
         uint64_t total_probe_length = 0, max_probe_length = 0;
 
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         for(uint64_t i = 0; i < N; ++i) {
             uint64_t probe_length = 0;
@@ -152,9 +219,11 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
             max_probe_length = std::max(max_probe_length, probe_length);
         };
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["find_linear"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_linear");
         results["find_linear_probes"] = total_probe_length;
         results["find_linear_max_probes"] = max_probe_length;
     }
@@ -164,6 +233,7 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
         uint64_t total_probe_length = 0, max_probe_length = 0;
         uint64_t indexed[UNROLL];
 
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         uint64_t stop_at = N - (N % UNROLL);
         for(uint64_t i = 0; i < stop_at; i += UNROLL) {
@@ -182,9 +252,11 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
             max_probe_length = std::max(max_probe_length, probe_length);
         }
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["find_unroll"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_unroll");
         results["find_unroll_probes"] = total_probe_length;
         results["find_unroll_max_probes"] = max_probe_length;
     }
@@ -194,6 +266,7 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
         uint64_t total_probe_length = 0, max_probe_length = 0;
         uint64_t prefetched[UNROLL];
 
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         uint64_t stop_at = N - (N % UNROLL);
         for(uint64_t i = 0; i < stop_at; i += UNROLL) {
@@ -212,43 +285,109 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
             max_probe_length = std::max(max_probe_length, probe_length);
         }
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["find_unroll_prefetch"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_unroll_prefetch");
         results["find_unroll_prefetch_probes"] = total_probe_length;
         results["find_unroll_prefetch_max_probes"] = max_probe_length;
     }
 
+    // traverse linear (batched lookups)
+    {
+        uint64_t values[BATCH];
+
+        counters.start();
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(uint64_t i = 0; i < N; i += BATCH) {
+            uint64_t n = std::min(BATCH, N - i);
+            map.find_batch(&keys[i], n, values);
+            for(uint64_t j = 0; j < n; ++j) { assert(values[j] == next[i + j]); }
+        }
+        const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
+
+        results["find_batch"] =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_batch");
+    }
+
+    // traverse linear (interleaved lookups)
+    {
+        uint64_t values[BATCH];
+
+        counters.start();
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(uint64_t i = 0; i < N; i += BATCH) {
+            uint64_t n = std::min(BATCH, N - i);
+            find_amac<AMAC_WIDTH>(map, &keys[i], n, values);
+            for(uint64_t j = 0; j < n; ++j) { assert(values[j] == next[i + j]); }
+        }
+        const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
+
+        results["find_amac"] =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_amac");
+    }
+
     // traverse linear (all elements directly)
     {
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         assert(map.sum_all_values() == N * (N - 1) / 2);
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["iterate_all_structure_aware"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "iterate_all_structure_aware");
     }
 
     // erase all elements
     {
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         for(uint64_t i = 0; i < N; ++i) { map.erase(i); }
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["erase"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "erase");
         results["erase_memory"] = map.memory_usage();
     }
     assert(map.size() == 0);
 
+    // give back the memory of a map that lost half its keys; one of its own, since the map
+    // above is empty by now
+    {
+        Map half;
+        for(uint64_t i = 0; i < N; ++i) { half.insert(i, next[i]); }
+        for(uint64_t i = 0; i < N; i += 2) { half.erase(i); }
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        half.shrink_to_fit();
+        const auto end = std::chrono::high_resolution_clock::now();
+
+        results["shrink_to_fit"] =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        results["shrink_to_fit_memory"] = half.memory_usage();
+        assert(half.size() == N / 2);
+    }
+
     // insert new keys in random order
     {
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         for(uint64_t i = 0; i < N; ++i) { map.insert(N + next[i], i); }
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["insert_2"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "insert_2");
         results["insert_2_memory"] = map.memory_usage();
     }
     assert(map.size() == N);
@@ -257,6 +396,7 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
     {
         uint64_t total_probe_length = 0, max_probe_length = 0;
 
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         for(uint64_t i = 0; i < N; ++i) {
             uint64_t probe_length = 0;
@@ -265,9 +405,11 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
             max_probe_length = std::max(max_probe_length, probe_length);
         };
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["find_new"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_new");
         results["find_new_probes"] = total_probe_length;
         results["find_new_max_probes"] = max_probe_length;
     }
@@ -276,6 +418,7 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
     {
         uint64_t total_probe_length = 0, max_probe_length = 0;
 
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         for(uint64_t i = 0; i < N; ++i) {
             uint64_t probe_length = 0;
@@ -284,21 +427,45 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
             max_probe_length = std::max(max_probe_length, probe_length);
         }
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["find_missing"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_missing");
         results["find_missing_probes"] = total_probe_length;
         results["find_missing_max_probes"] = max_probe_length;
     }
 
+    // attempt to find missing keys (batched)
+    {
+        bool found[BATCH];
+
+        counters.start();
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(uint64_t i = 0; i < N; i += BATCH) {
+            uint64_t n = std::min(BATCH, N - i);
+            map.contains_batch(&keys[i], n, found);
+            for(uint64_t j = 0; j < n; ++j) { assert(!found[j]); }
+        }
+        const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
+
+        results["find_missing_batch"] =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "find_missing_batch");
+    }
+
     // clear map
     {
+        counters.start();
         const auto start = std::chrono::high_resolution_clock::now();
         map.clear();
         const auto end = std::chrono::high_resolution_clock::now();
+        counters.stop();
 
         results["clear"] =
             std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        counters.record(results, "clear");
         results["clear_memory"] = map.memory_usage();
     }
     assert(map.size() == 0);
@@ -306,17 +473,111 @@ auto throughput() -> std::unordered_map<std::string, uint64_t> {
     return results;
 }
 
+const std::string COUNTER_PHASES[] = {"insert_1",
+                                      "insert_reserved",
+                                      "find_satollo",
+                                      "find_linear",
+                                      "find_unroll",
+                                      "find_unroll_prefetch",
+                                      "find_batch",
+                                      "find_amac",
+                                      "iterate_all_structure_aware",
+                                      "erase",
+                                      "insert_2",
+                                      "find_new",
+                                      "find_missing",
+                                      "find_missing_batch",
+                                      "clear"};
+const std::string LATENCY_PHASES[] = {"insert", "find", "find_missing", "erase"};
+
+// Separate from throughput() so the timestamps don't skew its totals. Records every operation in
+// cycles, including the ones that trigger a grow().
+template<Hashtable Map, uint64_t LF>
+auto latency(uint64_t capacity) -> std::unordered_map<std::string, Histogram> {
+    Map map;
+    std::unordered_map<std::string, Histogram> results;
+
+    const uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(capacity) * static_cast<double>(LF) / 100.0) - 1;
+
+    {
+        Histogram& h = results["insert"];
+        for(uint64_t i = 0; i < N; ++i) {
+            const uint64_t start = rdtsc();
+            map.insert(i, i);
+            h.record(rdtsc() - start);
+        }
+    }
+    assert(map.size() == N);
+
+    {
+        Histogram& h = results["find"];
+        uint64_t probe_length = 0;
+        for(uint64_t i = 0; i < N; ++i) {
+            const uint64_t start = rdtsc();
+            uint64_t value = map.find(i, &probe_length);
+            h.record(rdtsc() - start);
+            assert(value == i);
+        }
+    }
+
+    {
+        Histogram& h = results["find_missing"];
+        uint64_t probe_length = 0;
+        for(uint64_t i = 0; i < N; ++i) {
+            const uint64_t start = rdtsc();
+            bool found = map.contains(N + i, &probe_length);
+            h.record(rdtsc() - start);
+            assert(!found);
+        }
+    }
+
+    {
+        Histogram& h = results["erase"];
+        for(uint64_t i = 0; i < N; ++i) {
+            const uint64_t start = rdtsc();
+            map.erase(i);
+            h.record(rdtsc() - start);
+        }
+    }
+    assert(map.size() == 0);
+
+    return results;
+}
+
+// the columns benchmark() writes to results.csv
+void results_header(std::ostream& out) {
+    out << "table,insert_1,insert_1_memory,find_satollo,find_satollo_probes,find_satollo_max_"
+           "probes,find_linear,find_linear_probes,find_linear_max_probes,"
+           "find_unroll,find_unroll_probes,find_unroll_max_probes,find_unroll_prefetch,find_"
+           "unroll_prefetch_probes,find_unroll_prefetch_max_probes,find_new,find_new_probes,"
+           "find_new_max_probes,find_missing,find_missing_probes,find_missing_max_probes,erase,"
+           "erase_memory,insert_2,insert_2_memory,clear,clear_memory,bytes_per_value,iterate_"
+           "all_structure_aware,find_batch,find_missing_batch,find_amac,shrink_to_fit_us,"
+           "shrink_to_fit_memory_kib,insert_reserved,insert_reserved_memory";
+    for(const auto& phase : COUNTER_PHASES) {
+        for(const char* counter : Perf_Counters::NAMES) { out << "," << phase << "_" << counter; }
+    }
+    if constexpr(LATENCY) {
+        for(const auto& phase : LATENCY_PHASES) {
+            out << "," << phase << "_p50," << phase << "_p99," << phase << "_p999," << phase
+                << "_max";
+        }
+    }
+    out << std::endl;
+}
+
 template<Hashtable Map, uint64_t LF, uint64_t UNROLL = 10>
-void benchmark(std::string name, std::ostream& out) {
+void benchmark(std::string name, uint64_t capacity, std::ostream& out) {
 
-    constexpr uint64_t N =
-        static_cast<uint64_t>(static_cast<double>(CAPACITY) * static_cast<double>(LF) / 100.0) - 1;
+    const uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(capacity) * static_cast<double>(LF) / 100.0) - 1;
     constexpr uint64_t COUNT = 10;
 
     std::unordered_map<std::string, uint64_t> results;
 
     for(uint64_t i = 0; i < COUNT; ++i) {
-        auto results_i = throughput<Map, LF, UNROLL>();
+        auto results_i = throughput<Map, LF, UNROLL>(capacity);
 
         for(const auto& [key, value] : results_i) {
             if(key == "find_satollo_max_probes" || key == "find_unroll_max_probes" ||
@@ -335,7 +596,17 @@ void benchmark(std::string name, std::ostream& out) {
             value /= COUNT;
     }
 
-    constexpr double Nd = static_cast<double>(N);
+    std::unordered_map<std::string, Histogram> latencies;
+
+    if constexpr(LATENCY) {
+        for(uint64_t i = 0; i < COUNT; ++i) {
+            auto latencies_i = latency<Map, LF>(capacity);
+            for(const auto& [key, h] : latencies_i) { latencies[key].merge(h); }
+        }
+    }
+
+    const double Nd = static_cast<double>(N);
+    const double tsc = tsc_per_ns();
 
     if constexpr(CSV) {
         out << name << "," << results["insert_1"] / Nd << ","
@@ -353,12 +624,36 @@ void benchmark(std::string name, std::ostream& out) {
             << results["erase_memory"] / (1024 * 1024) << "," << results["insert_2"] / Nd << ","
             << results["insert_2_memory"] / (1024 * 1024) << "," << results["clear"] / Nd << ","
             << results["clear_memory"] / (1024 * 1024) << "," << results["insert_1_memory"] / Nd
-            << "," << results["iterate_all_structure_aware"] / Nd << std::endl;
+            << "," << results["iterate_all_structure_aware"] / Nd << ","
+            << results["find_batch"] / Nd << "," << results["find_missing_batch"] / Nd << ","
+            << results["find_amac"] / Nd << "," << results["shrink_to_fit"] / 1000.0 << ","
+            << results["shrink_to_fit_memory"] / 1024 << ","
+            << results["insert_reserved"] / Nd << ","
+            << results["insert_reserved_memory"] / (1024 * 1024);
+        // per operation; left empty when the counter couldn't be opened
+        for(const auto& phase : COUNTER_PHASES) {
+            for(const char* counter : Perf_Counters::NAMES) {
+                auto value = results.find(phase + "_" + counter);
+                out << ",";
+                if(value != results.end()) out << value->second / Nd;
+            }
+        }
+        if constexpr(LATENCY) {
+            for(const auto& phase : LATENCY_PHASES) {
+                Histogram& h = latencies[phase];
+                out << "," << h.percentile(0.5) / tsc << "," << h.percentile(0.99) / tsc << ","
+                    << h.percentile(0.999) / tsc << "," << h.max / tsc;
+            }
+        }
+        out << std::endl;
 
     } else {
         out << "insert: " << results["insert_1"] / Nd
             << " ns/ins | mem: " << results["insert_1_memory"] / (1024 * 1024) << " mb"
             << std::endl;
+        out << "insert reserved: " << results["insert_reserved"] / Nd
+            << " ns/ins | mem: " << results["insert_reserved_memory"] / (1024 * 1024) << " mb"
+            << std::endl;
         out << "bytes per element: " << results["insert_1_memory"] / Nd << std::endl;
 
         out << "find no-unroll: " << results["find_satollo"] / Nd
@@ -373,11 +668,15 @@ void benchmark(std::string name, std::ostream& out) {
         out << "find unroll prefetch: " << results["find_unroll_prefetch"] / Nd
             << " ns/find | avg probe: " << results["find_unroll_prefetch_probes"] / Nd
             << " | max probe: " << results["find_unroll_prefetch_max_probes"] << std::endl;
+        out << "find batch: " << results["find_batch"] / Nd << " ns/find" << std::endl;
+        out << "find amac: " << results["find_amac"] / Nd << " ns/find" << std::endl;
         out << "sum all values: " << results["iterate_all_structure_aware"] / Nd << " ns/val"
             << std::endl;
 
         out << "erase: " << results["erase"] / Nd
             << " ns/erase | mem: " << results["erase_memory"] / (1024 * 1024) << " mb" << std::endl;
+        out << "shrink to fit: " << results["shrink_to_fit"] / 1000.0
+            << " us | mem: " << results["shrink_to_fit_memory"] / 1024 << " kb" << std::endl;
         out << "insert after erase: " << results["insert_2"] / Nd
             << " ns/ins | mem: " << results["insert_2_memory"] / (1024 * 1024) << " mb"
             << std::endl;
@@ -387,32 +686,518 @@ void benchmark(std::string name, std::ostream& out) {
         out << "find missing: " << results["find_missing"] / Nd
             << " ns/find | avg probe: " << results["find_missing_probes"] / Nd
             << " | max probe: " << results["find_missing_max_probes"] << std::endl;
+        out << "find missing batch: " << results["find_missing_batch"] / Nd << " ns/find"
+            << std::endl;
 
         out << "clear: " << results["clear"] / (1000.0 * 1000.0)
             << "ms | mem: " << results["clear_memory"] / (1024 * 1024) << " mb" << std::endl;
+
+        for(const auto& phase : COUNTER_PHASES) {
+            if(results.find(phase + "_" + Perf_Counters::NAMES[0]) == results.end()) continue;
+            out << phase << " per op:";
+            for(const char* counter : Perf_Counters::NAMES) {
+                auto value = results.find(phase + "_" + counter);
+                if(value != results.end()) out << " " << counter << " " << value->second / Nd;
+            }
+            out << std::endl;
+        }
+        if constexpr(LATENCY) {
+            for(const auto& phase : LATENCY_PHASES) {
+                Histogram& h = latencies[phase];
+                out << phase << " latency: p50 " << h.percentile(0.5) / tsc << " ns | p99 "
+                    << h.percentile(0.99) / tsc << " ns | p99.9 " << h.percentile(0.999) / tsc
+                    << " ns | max " << h.max / tsc << " ns" << std::endl;
+            }
+        }
+    }
+}
+
+// Map must be safe to use from multiple threads. Each thread runs a fixed number of random
+// operations over a key space twice the size of the prepopulated map, so about half of all
+// reads miss and inserts and erases keep the size roughly stable.
+template<Hashtable Map, uint64_t LF>
+void benchmark_mt(std::string name, std::ostream& out) {
+
+    constexpr uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(CAPACITY) * static_cast<double>(LF) / 100.0) - 1;
+    constexpr uint64_t OPS = 1 << 22;
+
+    const uint64_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::pair<std::string, uint64_t> mixes[] = {
+        {"read_only", 0}, {"read_90_write_10", 10}, {"read_50_write_50", 50}};
+
+    // threads inserting the same keys into a growing map must leave each key there once, with a
+    // value one of them wrote
+    {
+        const uint64_t threads = std::max<uint64_t>(2, max_threads);
+        Map map;
+        std::vector<std::thread> workers;
+        for(uint64_t t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                for(uint64_t i = 0; i < N; ++i) { map.insert(i, i * threads + t); }
+            });
+        }
+        for(auto& w : workers) { w.join(); }
+        assert(map.size() == N);
+        for(uint64_t i = 0; i < N; ++i) {
+            uint64_t probe_length = 0;
+            assert(map.find(i, &probe_length) / threads == i);
+        }
+    }
+
+    for(const auto& [mix, write_percent] : mixes) {
+        for(uint64_t threads = 1;; threads = std::min(threads * 2, max_threads)) {
+            Map map;
+            for(uint64_t i = 0; i < N; ++i) { map.insert(i, i); }
+
+            std::atomic<bool> go{false};
+            std::vector<std::thread> workers;
+            for(uint64_t t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t, write_percent = write_percent]() {
+                    uint64_t found = 0;
+                    while(!go.load()) {}
+                    for(uint64_t i = 0; i < OPS; ++i) {
+                        uint64_t r = squirrel3(t * OPS + i);
+                        uint64_t key = r % (2 * N);
+                        if((r >> 32) % 100 < write_percent) {
+                            if((r >> 48) & 1)
+                                map.insert(key, key);
+                            else
+                                map.erase(key);
+                        } else {
+                            uint64_t probe_length = 0;
+                            found += map.contains(key, &probe_length);
+                        }
+                    }
+                    assert(found <= OPS);
+                });
+            }
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            go.store(true);
+            for(auto& w : workers) { w.join(); }
+            const auto end = std::chrono::high_resolution_clock::now();
+
+            const double seconds = std::chrono::duration<double>(end - start).count();
+            const double ops_per_sec = static_cast<double>(threads * OPS) / seconds;
+
+            if constexpr(CSV) {
+                out << name << "," << mix << "," << threads << "," << ops_per_sec << std::endl;
+            } else {
+                out << mix << " with " << threads << " threads: " << ops_per_sec / 1e6
+                    << " Mops/s" << std::endl;
+            }
+            if(threads == max_threads) break;
+        }
+    }
+}
+
+// Hashing cost and the probe lengths a hash gives Linear at 90% load, for a few key patterns.
+// Probe lengths come from placing every key with a union-find over the next free slot, so a
+// hash that clusters badly costs the same as a good one instead of going quadratic.
+template<typename Hash>
+void benchmark_hash(std::string name, std::ostream& out) {
+
+    constexpr uint64_t N = CAPACITY / 10 * 9;
+    constexpr uint64_t MASK = std::bit_ceil(CAPACITY) - 1;
+
+    std::mt19937_64 rng{};
+    std::vector<uint64_t> keys(N), next(MASK + 1);
+    const std::string patterns[] = {"sequential", "strided", "random"};
+
+    for(const auto& pattern : patterns) {
+        for(uint64_t i = 0; i < N; ++i) {
+            if(pattern == "sequential")
+                keys[i] = i;
+            else if(pattern == "strided")
+                keys[i] = i << 12;
+            else
+                keys[i] = rng();
+        }
+
+        uint64_t sum = 0;
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(uint64_t i = 0; i < N; ++i) { sum += Hash{}(keys[i]); }
+        const auto end = std::chrono::high_resolution_clock::now();
+        // keep the hashing loop from being optimized out
+        volatile uint64_t sink = sum;
+        (void)sink;
+
+        // next[i] leads to the first free slot at or after i
+        for(uint64_t i = 0; i <= MASK; ++i) { next[i] = i; }
+        uint64_t total_probe_length = 0, max_probe_length = 0;
+        for(uint64_t i = 0; i < N; ++i) {
+            uint64_t home = Hash{}(keys[i]) & MASK;
+            uint64_t slot = home;
+            while(next[slot] != slot) { slot = next[slot] = next[next[slot]]; }
+            next[slot] = (slot + 1) & MASK;
+            uint64_t probe_length = (slot - home) & MASK;
+            total_probe_length += probe_length;
+            max_probe_length = std::max(max_probe_length, probe_length);
+        }
+
+        const double ns = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        const double avg_probe_length = static_cast<double>(total_probe_length) / N;
+
+        if constexpr(CSV) {
+            out << name << "," << pattern << "," << ns / N << "," << avg_probe_length << ","
+                << max_probe_length << std::endl;
+        } else {
+            out << pattern << ": " << ns / N << " ns/hash | avg probe: " << avg_probe_length
+                << " | max probe: " << max_probe_length << std::endl;
+        }
+    }
+}
+
+// Keys for benchmark_keys: every i gives a distinct key, and keys at i >= N are never inserted.
+// The strings are too long for the small string optimization, so each one owns a heap block.
+template<typename K>
+K make_key(uint64_t i) {
+    if constexpr(std::same_as<K, uint64_t>) {
+        return i;
+    } else if constexpr(std::same_as<K, Key128>) {
+        return Key128{squirrel3(i), i};
+    } else {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "user/%016llx/profile",
+                      static_cast<unsigned long long>(squirrel3(i)));
+        return K(buf);
+    }
+}
+
+// Cost per operation for the tables that take a key type, with 64-bit, 128-bit and string
+// keys. Lookups and erases take their keys from an array, as in find_batch().
+template<typename Map, typename K, uint64_t LF>
+void benchmark_keys(std::string name, std::ostream& out) {
+
+    constexpr uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(CAPACITY) * static_cast<double>(LF) / 100.0) - 1;
+
+    std::vector<K> keys, missing;
+    keys.reserve(N);
+    missing.reserve(N);
+    for(uint64_t i = 0; i < N; ++i) {
+        keys.push_back(make_key<K>(i));
+        missing.push_back(make_key<K>(N + i));
+    }
+
+    Map map;
+    std::unordered_map<std::string, double> ns;
+    const auto time = [&](const std::string& phase, auto&& op) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(uint64_t i = 0; i < N; ++i) { op(i); }
+        const auto end = std::chrono::high_resolution_clock::now();
+        ns[phase] = static_cast<double>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+                    N;
+    };
+
+    uint64_t found = 0;
+    time("insert", [&](uint64_t i) { map.insert(keys[i], i); });
+    assert(map.size() == N);
+    const uint64_t memory = map.memory_usage();
+    time("find", [&](uint64_t i) {
+        uint64_t probe_length = 0;
+        assert(map.find(keys[i], &probe_length) == i);
+    });
+    time("find_missing", [&](uint64_t i) {
+        uint64_t probe_length = 0;
+        found += map.contains(missing[i], &probe_length);
+    });
+    assert(found == 0);
+    time("erase", [&](uint64_t i) { map.erase(keys[i]); });
+    assert(map.size() == 0);
+
+    const double bytes_per_value = static_cast<double>(memory) / N;
+    if constexpr(CSV) {
+        out << name << "," << ns["insert"] << "," << ns["find"] << "," << ns["find_missing"] << ","
+            << ns["erase"] << "," << bytes_per_value << std::endl;
+    } else {
+        out << "insert: " << ns["insert"] << " ns | find: " << ns["find"]
+            << " ns | find missing: " << ns["find_missing"] << " ns | erase: " << ns["erase"]
+            << " ns | " << bytes_per_value << " bytes/value" << std::endl;
+    }
+}
+
+// Startup cost of a table with N keys: re-inserting every key, against load_mmap() of a
+// snapshot. Each is followed by a pass of lookups, which is where a mapped table pays for its
+// page faults. The snapshot has just been written, so it is read from the page cache.
+template<Hashtable Map, uint64_t LF>
+void benchmark_startup(std::string name, std::ostream& out) {
+
+    constexpr uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(CAPACITY) * static_cast<double>(LF) / 100.0) - 1;
+    const std::string path = name + ".snapshot";
+
+    const auto ns_since = [](auto start) {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::high_resolution_clock::now() - start)
+                                       .count());
+    };
+    const auto find_all = [](Map& map) {
+        for(uint64_t i = 0; i < N; ++i) {
+            uint64_t probe_length = 0;
+            assert(map.find(i, &probe_length) == squirrel3(i));
+        }
+    };
+
+    double rebuild_ns, rebuilt_find_ns, save_ns, load_ns, mapped_find_ns;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        Map map;
+        for(uint64_t i = 0; i < N; ++i) { map.insert(i, squirrel3(i)); }
+        rebuild_ns = ns_since(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        find_all(map);
+        rebuilt_find_ns = ns_since(start);
+
+        start = std::chrono::high_resolution_clock::now();
+        assert(map.save(path.c_str()));
+        save_ns = ns_since(start);
+    }
+    uint64_t snapshot_bytes = 0;
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        Map map;
+        assert(map.load_mmap(path.c_str()));
+        load_ns = ns_since(start);
+        snapshot_bytes = map.mapped_bytes;
+        assert(map.size() == N);
+
+        start = std::chrono::high_resolution_clock::now();
+        find_all(map);
+        mapped_find_ns = ns_since(start);
+    }
+    std::remove(path.c_str());
+
+    if constexpr(CSV) {
+        out << name << "," << rebuild_ns / 1e6 << "," << rebuilt_find_ns / N << "," << save_ns / 1e6
+            << "," << load_ns / 1e6 << "," << mapped_find_ns / N << "," << snapshot_bytes
+            << std::endl;
+    } else {
+        out << "rebuild: " << rebuild_ns / 1e6 << " ms, then " << rebuilt_find_ns / N
+            << " ns/find | save: " << save_ns / 1e6 << " ms | load_mmap: " << load_ns / 1e6
+            << " ms, then " << mapped_find_ns / N << " ns/find | " << snapshot_bytes
+            << " bytes on disk" << std::endl;
+    }
+}
+
+// A read-only dictionary of N random keys, built once and then only queried. Tables with a
+// build() get the whole key set at once; the others insert it. Each value is the index of the
+// next key on a satollo cycle, so find_chain can't overlap its lookups.
+template<typename Map>
+void benchmark_static(std::string name, std::ostream& out) {
+
+    constexpr uint64_t N = CAPACITY / 10 * 9;
+
+    std::mt19937_64 rng{};
+    std::vector<uint64_t> keys(N), next(N), missing(N);
+    for(uint64_t i = 0; i < N; ++i) {
+        // the top bit marks keys that are never inserted
+        keys[i] = rng() >> 1;
+        missing[i] = rng() | (1ull << 63);
+        next[i] = i;
+    }
+    for(uint64_t i = 0; i < N - 1; i++) {
+        uint64_t j = i + 1 + rng() % (N - i - 1);
+        std::swap(next[i], next[j]);
+    }
+
+    const auto ns_per_key = [](auto start) {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::high_resolution_clock::now() - start)
+                                       .count()) /
+               N;
+    };
+
+    Map map;
+    auto start = std::chrono::high_resolution_clock::now();
+    if constexpr(requires { map.build(keys.data(), next.data(), N); }) {
+        assert(map.build(keys.data(), next.data(), N));
+    } else {
+        for(uint64_t i = 0; i < N; ++i) { map.insert(keys[i], next[i]); }
+    }
+    const double build = ns_per_key(start) * N / 1e6;
+    assert(map.size() == N);
+
+    start = std::chrono::high_resolution_clock::now();
+    for(uint64_t i = 0; i < N; ++i) {
+        uint64_t probe_length = 0;
+        assert(map.find(keys[i], &probe_length) == next[i]);
+    }
+    const double find_linear = ns_per_key(start);
+
+    uint64_t index = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for(uint64_t i = 0; i < N; ++i) {
+        uint64_t probe_length = 0;
+        index = map.find(keys[index], &probe_length);
+    }
+    const double find_chain = ns_per_key(start);
+    assert(index == 0);
+
+    uint64_t found = 0;
+    start = std::chrono::high_resolution_clock::now();
+    for(uint64_t i = 0; i < N; ++i) {
+        uint64_t probe_length = 0;
+        found += map.contains(missing[i], &probe_length);
+    }
+    const double find_missing = ns_per_key(start);
+    assert(found == 0);
+
+    uint64_t values[BATCH];
+    start = std::chrono::high_resolution_clock::now();
+    for(uint64_t i = 0; i < N; i += BATCH) {
+        uint64_t n = std::min(BATCH, N - i);
+        map.find_batch(&keys[i], n, values);
+        for(uint64_t j = 0; j < n; ++j) { assert(values[j] == next[i + j]); }
+    }
+    const double find_batch = ns_per_key(start);
+
+    const double bytes_per_key = static_cast<double>(map.memory_usage()) / N;
+    if constexpr(CSV) {
+        out << name << "," << build << "," << bytes_per_key << "," << find_linear << ","
+            << find_chain << "," << find_missing << "," << find_batch << std::endl;
+    } else {
+        out << "build: " << build << " ms | " << bytes_per_key << " bytes/key | find: "
+            << find_linear << " ns | find chain: " << find_chain << " ns | find missing: "
+            << find_missing << " ns | find batch: " << find_batch << " ns" << std::endl;
+    }
+}
+
+// Building a table from arrays of N pairs: the usual insert loop, against bulk_build(), which
+// sizes the table once and fills it from every hardware thread. Keys are random so the input
+// order says nothing about where they land.
+template<Hashtable Map, uint64_t LF>
+void benchmark_build(std::string name, std::ostream& out) {
+
+    constexpr uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(CAPACITY) * static_cast<double>(LF) / 100.0) - 1;
+
+    std::mt19937_64 rng{};
+    std::vector<uint64_t> keys(N), values(N);
+    for(uint64_t i = 0; i < N; ++i) {
+        // top bit clear, so no key collides with a sentinel
+        keys[i] = rng() >> 1;
+        values[i] = i;
+    }
+
+    const auto ms_since = [](auto start) {
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::high_resolution_clock::now() - start)
+                                       .count()) /
+               1e6;
+    };
+
+    double insert_ms, bulk_ms;
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        Map map;
+        for(uint64_t i = 0; i < N; ++i) { map.insert(keys[i], values[i]); }
+        insert_ms = ms_since(start);
+    }
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        Map map;
+        map.bulk_build(keys.data(), values.data(), N);
+        bulk_ms = ms_since(start);
+
+        assert(map.size() == N);
+        for(uint64_t i = 0; i < N; ++i) {
+            uint64_t probe_length = 0;
+            assert(map.find(keys[i], &probe_length) == values[i]);
+        }
+    }
+
+    const uint64_t threads = hardware_threads();
+    if constexpr(CSV) {
+        out << name << "," << threads << "," << insert_ms << "," << bulk_ms << ","
+            << N / insert_ms / 1e3 << "," << N / bulk_ms / 1e3 << std::endl;
+    } else {
+        out << "insert loop: " << insert_ms << " ms (" << N / insert_ms / 1e3
+            << " Mpairs/s) | bulk_build on " << threads << " threads: " << bulk_ms << " ms ("
+            << N / bulk_ms / 1e3 << " Mpairs/s)" << std::endl;
+    }
+}
+
+// Times one grow() of a table filled to its load factor at CAPACITY slots, once with the serial
+// insert loop and once with grow_threads set to every hardware thread.
+template<Hashtable Map, uint64_t LF>
+void benchmark_grow(std::string name, std::ostream& out) {
+
+    constexpr uint64_t N =
+        static_cast<uint64_t>(static_cast<double>(CAPACITY) * static_cast<double>(LF) / 100.0) - 1;
+
+    std::mt19937_64 rng{};
+    std::vector<uint64_t> keys(N);
+    for(uint64_t i = 0; i < N; ++i) keys[i] = rng() >> 1;
+
+    // at least two, so the parallel path runs even on one core
+    const uint64_t threads = std::max<uint64_t>(2, hardware_threads());
+    double ms[2];
+    for(uint64_t parallel = 0; parallel < 2; parallel++) {
+        Map map;
+        for(uint64_t i = 0; i < N; ++i) { map.insert(keys[i], i); }
+        map.grow_threads = parallel ? threads : 1;
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        map.grow();
+        ms[parallel] = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                               std::chrono::high_resolution_clock::now() - start)
+                                               .count()) /
+                       1e6;
+
+        assert(map.size() == N);
+        for(uint64_t i = 0; i < N; ++i) {
+            uint64_t probe_length = 0;
+            assert(map.find(keys[i], &probe_length) == i);
+        }
+    }
+
+    if constexpr(CSV) {
+        out << name << "," << threads << "," << ms[0] << "," << ms[1] << std::endl;
+    } else {
+        out << "grow: " << ms[0] << " ms serial | " << ms[1] << " ms on " << threads
+            << " threads" << std::endl;
     }
 }
 
 int main(int argc, char** argv) {
 
-    std::map<std::string, std::function<void(std::string, std::ostream&)>> benchmarks = {
+    std::map<std::string, std::function<void(std::string, uint64_t, std::ostream&)>>
+        benchmarks = {
         {"chaining_50", benchmark<Chaining<50>, 50>},
         {"chaining_100", benchmark<Chaining<100>, 100>},
         {"chaining_200", benchmark<Chaining<200>, 200>},
         {"chaining_500", benchmark<Chaining<500>, 500>},
+        {"chaining_unrolled_50", benchmark<Chaining_Unrolled<50>, 50>},
+        {"chaining_unrolled_100", benchmark<Chaining_Unrolled<100>, 100>},
+        {"chaining_unrolled_200", benchmark<Chaining_Unrolled<200>, 200>},
+        {"chaining_unrolled_500", benchmark<Chaining_Unrolled<500>, 500>},
         {"two_way_2", benchmark<Two_Way<2>, 100>},
         {"two_way_4", benchmark<Two_Way<4>, 100>},
         {"two_way_8", benchmark<Two_Way<8>, 100>},
-        {"two_way_simd", benchmark<Two_Way_SIMD, 100>},
+        {"two_way_simd", benchmark<Two_Way_SIMD<>, 100>},
+        {"cuckoo_90", benchmark<Cuckoo<90>, 90>},
+        {"cuckoo_95", benchmark<Cuckoo<95>, 95>},
         {"robin_hood_50", benchmark<Robin_Hood<50>, 50>},
         {"robin_hood_75", benchmark<Robin_Hood<75>, 75>},
         {"robin_hood_90", benchmark<Robin_Hood<90>, 90>},
+        {"robin_hood_huge_90", benchmark<Robin_Hood<90, Huge_Alloc<>>, 90>},
+        {"robin_hood_incremental_50", benchmark<Robin_Hood_Incremental<50, 8>, 50>},
+        {"robin_hood_incremental_75", benchmark<Robin_Hood_Incremental<75, 8>, 75>},
+        {"robin_hood_incremental_90", benchmark<Robin_Hood_Incremental<90, 8>, 90>},
         {"robin_hood_with_deletion_50", benchmark<Robin_Hood_With_Deletion<50>, 50>},
         {"robin_hood_with_deletion_75", benchmark<Robin_Hood_With_Deletion<75>, 75>},
         {"robin_hood_with_deletion_90", benchmark<Robin_Hood_With_Deletion<90>, 90>},
         {"robin_hood_with_desired_50", benchmark<Robin_Hood_With_Desired<50>, 50>},
         {"robin_hood_with_desired_75", benchmark<Robin_Hood_With_Desired<75>, 75>},
         {"robin_hood_with_desired_90", benchmark<Robin_Hood_With_Desired<90>, 90>},
+        {"robin_hood_with_metadata_50", benchmark<Robin_Hood_With_Metadata<50>, 50>},
+        {"robin_hood_with_metadata_75", benchmark<Robin_Hood_With_Metadata<75>, 75>},
+        {"robin_hood_with_metadata_90", benchmark<Robin_Hood_With_Metadata<90>, 90>},
         {"linear_with_deletion_50", benchmark<Linear_With_Deletion<50>, 50>},
         {"linear_with_deletion_75", benchmark<Linear_With_Deletion<75>, 75>},
         {"linear_with_deletion_90", benchmark<Linear_With_Deletion<90>, 90>},
@@ -422,50 +1207,205 @@ int main(int argc, char** argv) {
         {"linear_50", benchmark<Linear<50>, 50>},
         {"linear_75", benchmark<Linear<75>, 75>},
         {"linear_90", benchmark<Linear<90>, 90>},
+        {"linear_huge_90", benchmark<Linear<90, Huge_Alloc<>>, 90>},
+        {"linear_huge_populate_90", benchmark<Linear<90, Huge_Alloc<true>>, 90>},
+        {"linear_fmix64_90", benchmark<Linear<90, Aligned_Alloc, Fmix64_Hash>, 90>},
+        {"linear_wy_90", benchmark<Linear<90, Aligned_Alloc, Wy_Hash>, 90>},
+        {"linear_incremental_50", benchmark<Linear_Incremental<50, 8>, 50>},
+        {"linear_incremental_75", benchmark<Linear_Incremental<75, 8>, 75>},
+        {"linear_incremental_90", benchmark<Linear_Incremental<90, 8>, 90>},
         {"linear_simd_50", benchmark<Linear_SIMD<50>, 50>},
         {"linear_simd_75", benchmark<Linear_SIMD<75>, 75>},
         {"linear_simd_90", benchmark<Linear_SIMD<90>, 90>},
+        {"swiss_50", benchmark<Swiss<50>, 50>},
+        {"swiss_75", benchmark<Swiss<75>, 75>},
+        {"swiss_90", benchmark<Swiss<90>, 90>},
+        {"swiss_huge_90", benchmark<Swiss<90, Huge_Alloc<>>, 90>},
+        {"swiss_95", benchmark<Swiss<95>, 95>},
+        {"hopscotch_50", benchmark<Hopscotch<50>, 50>},
+        {"hopscotch_75", benchmark<Hopscotch<75>, 75>},
+        {"hopscotch_90", benchmark<Hopscotch<90>, 90>},
         {"quadratic_50", benchmark<Quadratic<50, 50>, 50>},
         {"quadratic_75", benchmark<Quadratic<75, 50>, 75>},
         {"quadratic_90", benchmark<Quadratic<90, 50>, 90>},
+        {"dense_50", benchmark<Dense<50>, 50>},
+        {"dense_75", benchmark<Dense<75>, 75>},
+        {"dense_90", benchmark<Dense<90>, 90>},
         {"double_50", benchmark<Double<50, 50>, 50>},
         {"double_75", benchmark<Double<75, 50>, 75>},
         {"double_90", benchmark<Double<90, 50>, 90>},
         {"stdumap", benchmark<Std_Map, 100>},
         {"stdumap_squirrel", benchmark<Std_Map_Squirrel3, 100>},
+        {"concurrent_linear_50", benchmark<Concurrent_Linear<50>, 50>},
+        {"concurrent_linear_75", benchmark<Concurrent_Linear<75>, 75>},
+        {"sharded_swiss_90", benchmark<Sharded<Swiss<90>, 64>, 90>},
+    };
+
+    // Benchmarks that run once rather than at each capacity, grouped by the CSV they write.
+    struct Family {
+        std::string file;
+        std::string header;
+        std::map<std::string, std::function<void(std::string, std::ostream&)>> benchmarks;
+    };
+    std::vector<Family> families = {
+        {"results_mt.csv",
+         "table,mix,threads,ops_per_sec",
+         {
+            {"concurrent_linear_50_mt", benchmark_mt<Concurrent_Linear<50>, 50>},
+            {"concurrent_linear_75_mt", benchmark_mt<Concurrent_Linear<75>, 75>},
+            {"sharded_chaining_100_mt", benchmark_mt<Sharded<Chaining<100>, 64>, 50>},
+            {"sharded_cuckoo_95_mt", benchmark_mt<Sharded<Cuckoo<95>, 64>, 50>},
+            {"sharded_hopscotch_90_mt", benchmark_mt<Sharded<Hopscotch<90>, 64>, 50>},
+            {"sharded_linear_with_rehash_75_mt",
+             benchmark_mt<Sharded<Linear_With_Rehash<75, 50>, 64>, 50>},
+            {"sharded_robin_hood_with_deletion_75_mt",
+             benchmark_mt<Sharded<Robin_Hood_With_Deletion<75>, 64>, 50>},
+            {"sharded_robin_hood_with_metadata_90_mt",
+             benchmark_mt<Sharded<Robin_Hood_With_Metadata<90>, 64>, 50>},
+            {"sharded_swiss_90_mt", benchmark_mt<Sharded<Swiss<90>, 64>, 50>},
+         }},
+        {"results_hash.csv",
+         "hash,keys,ns_per_hash,avg_probes,max_probes",
+         {
+            {"hash_squirrel3", benchmark_hash<Squirrel3_Hash>},
+            {"hash_fx", benchmark_hash<Fx_Hash>},
+            {"hash_fmix64", benchmark_hash<Fmix64_Hash>},
+            {"hash_wy", benchmark_hash<Wy_Hash>},
+            {"hash_crc32", benchmark_hash<Crc32_Hash>},
+            {"hash_identity", benchmark_hash<Identity_Hash>},
+         }},
+        {"results_keys.csv",
+         "table,insert,find,find_missing,erase,bytes_per_value",
+         {
+            {"keys_linear_string_75", benchmark_keys<Linear_String<75>, std::string, 75>},
+            {"keys_linear_string_90", benchmark_keys<Linear_String<90>, std::string, 90>},
+            {"keys_robin_hood_with_metadata_u64_90",
+             benchmark_keys<Robin_Hood_With_Metadata<90>, uint64_t, 90>},
+            {"keys_robin_hood_with_metadata_u128_90",
+             benchmark_keys<Robin_Hood_With_Metadata<90, Key128_Hash, Key128>, Key128, 90>},
+            {"keys_robin_hood_with_metadata_string_90",
+             benchmark_keys<Robin_Hood_With_Metadata<90, String_Hash, std::string>, std::string,
+                            90>},
+            {"keys_swiss_u64_90", benchmark_keys<Swiss<90>, uint64_t, 90>},
+            {"keys_swiss_u128_90",
+             benchmark_keys<Swiss<90, Aligned_Alloc, Key128_Hash, Key128>, Key128, 90>},
+            {"keys_swiss_string_90",
+             benchmark_keys<Swiss<90, Aligned_Alloc, String_Hash, std::string>, std::string, 90>},
+            {"keys_stdumap_u64", benchmark_keys<Std_Map_Squirrel3, uint64_t, 100>},
+            {"keys_stdumap_u128", benchmark_keys<Std_Map_<Key128_Hash, Key128>, Key128, 100>},
+            {"keys_stdumap_string",
+             benchmark_keys<Std_Map_<String_Hash, std::string>, std::string, 100>},
+         }},
+        {"results_startup.csv",
+         "table,rebuild_ms,rebuilt_find,save_ms,load_mmap_ms,mapped_find,snapshot_bytes",
+         {
+            {"startup_linear_90", benchmark_startup<Linear<90>, 90>},
+            {"startup_linear_simd_90", benchmark_startup<Linear_SIMD<90>, 90>},
+            {"startup_robin_hood_90", benchmark_startup<Robin_Hood<90>, 90>},
+            {"startup_two_way_simd", benchmark_startup<Two_Way_SIMD<>, 100>},
+         }},
+        {"results_static.csv",
+         "table,build_ms,bytes_per_key,find_linear,find_chain,find_missing,find_batch",
+         {
+            {"static_perfect", benchmark_static<Perfect<>>},
+            {"static_linear_simd_90", benchmark_static<Linear_SIMD<90>>},
+            {"static_two_way_simd", benchmark_static<Two_Way_SIMD<>>},
+         }},
+        {"results_build.csv",
+         "table,threads,insert_ms,bulk_build_ms,insert_mpairs_per_s,bulk_build_mpairs_per_s",
+         {
+            {"build_linear_50", benchmark_build<Linear<50>, 50>},
+            {"build_linear_90", benchmark_build<Linear<90>, 90>},
+            {"build_linear_simd_90", benchmark_build<Linear_SIMD<90>, 90>},
+            {"build_robin_hood_50", benchmark_build<Robin_Hood<50>, 50>},
+            {"build_robin_hood_90", benchmark_build<Robin_Hood<90>, 90>},
+         }},
+        {"results_grow.csv",
+         "table,threads,serial_ms,parallel_ms",
+         {
+            {"grow_linear_90", benchmark_grow<Linear<90>, 90>},
+            {"grow_robin_hood_90", benchmark_grow<Robin_Hood<90>, 90>},
+            {"grow_linear_with_rehash_90", benchmark_grow<Linear_With_Rehash<90, 50>, 90>},
+            {"grow_quadratic_90", benchmark_grow<Quadratic<90, 50>, 90>},
+            {"grow_double_90", benchmark_grow<Double<90, 50>, 90>},
+         }},
     };
 
+    // Hashtables [--sweep MIN MAX [FACTOR]] [tables...]
+    // A sweep runs each single-threaded table at capacities MIN, MIN * FACTOR, ... up to MAX. The
+    // default factor is below 2 so the points fall at different fill levels between two grows.
+    std::vector<uint64_t> capacities = {CAPACITY};
+    bool sweep = false;
+    int first = 1;
+    if(argc >= 4 && std::string(argv[1]) == "--sweep") {
+        sweep = true;
+        const uint64_t min = std::max(std::strtoull(argv[2], nullptr, 10), 16ull);
+        const uint64_t max = std::strtoull(argv[3], nullptr, 10);
+        double factor = 1.25;
+        first = 4;
+        if(argc >= 5) {
+            char* end = nullptr;
+            double f = std::strtod(argv[4], &end);
+            if(*end == '\0') {
+                factor = f;
+                first = 5;
+            }
+        }
+        if(factor <= 1.0 || max < min) {
+            std::cout << "usage: " << argv[0] << " --sweep MIN MAX [FACTOR > 1] [tables...]"
+                      << std::endl;
+            return 1;
+        }
+        capacities.clear();
+        for(double c = static_cast<double>(min); c <= static_cast<double>(max); c *= factor) {
+            uint64_t capacity = static_cast<uint64_t>(c);
+            if(capacities.empty() || capacity > capacities.back()) capacities.push_back(capacity);
+        }
+    }
+
     std::vector<std::string> run;
-    if(argc == 1) {
+    if(argc == first) {
         for(auto& b : benchmarks) { run.push_back(b.first); }
+        if(!sweep) {
+            for(auto& family : families) {
+                for(auto& b : family.benchmarks) { run.push_back(b.first); }
+            }
+        }
     } else {
-        for(int i = 1; i < argc; ++i) { run.push_back(argv[i]); }
+        for(int i = first; i < argc; ++i) { run.push_back(argv[i]); }
     }
 
-    if constexpr(CSV) {
-        std::ofstream out("results.csv", std::ios::out | std::ios::trunc);
-        out << "table,insert_1,insert_1_memory,find_satollo,find_satollo_probes,find_satollo_max_"
-               "probes,find_linear,find_linear_probes,find_linear_max_probes,"
-               "find_unroll,find_unroll_probes,find_unroll_max_probes,find_unroll_prefetch,find_"
-               "unroll_prefetch_probes,find_unroll_prefetch_max_probes,find_new,find_new_probes,"
-               "find_new_max_probes,find_missing,find_missing_probes,find_missing_max_probes,erase,"
-               "erase_memory,insert_2,insert_2_memory,clear,clear_memory,bytes_per_value,iterate_"
-               "all_structure_aware"
-            << std::endl;
-        for(auto& b : run) {
-            if(benchmarks.find(b) != benchmarks.end()) { 
-                std::cout << "Running " << b << "..." << std::endl;
-                benchmarks[b](b, out); 
+    // a CSV is only opened, which truncates it, once one of its benchmarks runs, so running a
+    // few benchmarks keeps the other files' results
+    std::ofstream out;
+    std::vector<std::ofstream> family_out(families.size());
+    for(auto& b : run) {
+        if constexpr(!CSV) std::cout << "Benchmark: " << b << std::endl;
+        if(benchmarks.find(b) != benchmarks.end()) {
+            if(CSV && !out.is_open()) {
+                out.open(sweep ? "results_sweep.csv" : "results.csv",
+                         std::ios::out | std::ios::trunc);
+                if(sweep) out << "capacity,";
+                results_header(out);
+            }
+            for(uint64_t capacity : capacities) {
+                std::cout << "Running " << b;
+                if(sweep) std::cout << " at capacity " << capacity;
+                std::cout << "..." << std::endl;
+                if(CSV && sweep) out << capacity << ",";
+                benchmarks[b](b, capacity, CSV ? out : std::cout);
             }
         }
-    } else {
-        for(auto& b : run) {
-            std::cout << "Benchmark: " << b << std::endl;
-            if(benchmarks.find(b) != benchmarks.end()) { 
-                std::cout << "Running " << b << "..." << std::endl;
-                benchmarks[b](b, std::cout); 
+        for(uint64_t f = 0; !sweep && f < families.size(); f++) {
+            auto found = families[f].benchmarks.find(b);
+            if(found == families[f].benchmarks.end()) continue;
+            if(CSV && !family_out[f].is_open()) {
+                family_out[f].open(families[f].file, std::ios::out | std::ios::trunc);
+                family_out[f] << families[f].header << std::endl;
             }
-            std::cout << std::endl;
+            std::cout << "Running " << b << "..." << std::endl;
+            found->second(b, CSV ? family_out[f] : std::cout);
         }
+        if constexpr(!CSV) std::cout << std::endl;
     }
 }
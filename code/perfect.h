@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+
+#include "base.h"
+
+// Read-only table over a fixed key set, built once with a PTHash-style minimal perfect hash.
+// Keys are split into buckets of about LAMBDA by the low half of their hash. Going from the
+// largest bucket to the smallest, each bucket gets the first pilot that sends all of its keys
+// to free positions, where a key's position is the high bits of hash ^ squirrel3(pilot) scaled
+// to n / ALPHA. The slack keeps the last, small buckets from needing millions of tries; the
+// few keys that land past n are then moved to the holes below n through the remap array. A
+// lookup reads the small pilot array and exactly one slot, never a probe.
+template<typename Hash = Squirrel3_Hash>
+struct Perfect {
+
+    static constexpr uint64_t LAMBDA = 3;
+    static constexpr double ALPHA = 0.97;
+    static constexpr uint64_t BATCH = 16;
+
+    Perfect() {
+        size_ = buckets = positions = 0;
+        pilots = remap = nullptr;
+        data = nullptr;
+    }
+    ~Perfect() { clear(); }
+
+    // x * n / 2^64, so the high bits of x pick the slot
+    static uint64_t scale(uint64_t x, uint64_t n) {
+#ifdef _WIN32
+        return __umulh(x, n);
+#else
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(x) * n) >> 64);
+#endif
+    }
+    uint64_t bucket_for(uint64_t hash) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(hash)) * buckets) >> 32;
+    }
+    uint64_t position_for(uint64_t hash, uint64_t pilot) {
+        return scale(hash ^ squirrel3(pilot), positions);
+    }
+
+    // Replaces the contents with n distinct keys. Returns false if two keys hash the same,
+    // since no pilot can separate those.
+    bool build(const uint64_t* keys, const uint64_t* values, uint64_t n) {
+        clear();
+        if(n == 0) return true;
+        assert(n < (1ull << 32));
+        size_ = n;
+        buckets = std::max<uint64_t>(1, n / LAMBDA);
+        positions = std::max(n, static_cast<uint64_t>(static_cast<double>(n) / ALPHA));
+        pilots = reinterpret_cast<uint32_t*>(__aligned_alloc(CACHE_LINE, buckets * 4));
+        remap = reinterpret_cast<uint32_t*>(__aligned_alloc(CACHE_LINE, (positions - n + 1) * 4));
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, n * sizeof(Slot)));
+        std::memset(pilots, 0, buckets * 4);
+
+        // counting sort of the keys by bucket, then of the buckets by size
+        std::vector<uint64_t> hashes(n), order(n), start(buckets + 1, 0);
+        for(uint64_t i = 0; i < n; i++) {
+            hashes[i] = Hash{}(keys[i]);
+            start[bucket_for(hashes[i]) + 1]++;
+        }
+        uint64_t largest = 0;
+        for(uint64_t b = 0; b < buckets; b++) {
+            largest = std::max(largest, start[b + 1]);
+            start[b + 1] += start[b];
+        }
+        {
+            std::vector<uint64_t> next(start.begin(), start.end() - 1);
+            for(uint64_t i = 0; i < n; i++) order[next[bucket_for(hashes[i])]++] = i;
+        }
+        std::vector<uint64_t> by_size, size_start(largest + 2, 0);
+        by_size.resize(buckets);
+        for(uint64_t b = 0; b < buckets; b++) size_start[largest - (start[b + 1] - start[b]) + 1]++;
+        for(uint64_t s = 0; s <= largest; s++) size_start[s + 1] += size_start[s];
+        for(uint64_t b = 0; b < buckets; b++) {
+            by_size[size_start[largest - (start[b + 1] - start[b])]++] = b;
+        }
+
+        std::vector<uint64_t> taken((positions + 63) / 64, 0), bucket(largest), slots(largest);
+        for(uint64_t b : by_size) {
+            uint64_t first = start[b], count = start[b + 1] - first;
+            if(count == 0) break;
+            for(uint64_t i = 0; i < count; i++) {
+                bucket[i] = hashes[order[first + i]];
+                for(uint64_t j = 0; j < i; j++) {
+                    if(bucket[i] == bucket[j]) {
+                        clear();
+                        return false;
+                    }
+                }
+            }
+            for(uint64_t pilot = 0;; pilot++) {
+                assert(pilot <= UINT32_MAX);
+                uint64_t placed = 0;
+                for(; placed < count; placed++) {
+                    uint64_t slot = position_for(bucket[placed], pilot);
+                    if(taken[slot / 64] >> (slot % 64) & 1) break;
+                    taken[slot / 64] |= 1ull << (slot % 64);
+                    slots[placed] = slot;
+                }
+                if(placed == count) {
+                    pilots[b] = static_cast<uint32_t>(pilot);
+                    break;
+                }
+                for(uint64_t i = 0; i < placed; i++) {
+                    taken[slots[i] / 64] &= ~(1ull << (slots[i] % 64));
+                }
+            }
+        }
+
+        // as many positions past n are taken as there are holes below it
+        uint64_t hole = 0;
+        for(uint64_t position = n; position < positions; position++) {
+            if(!(taken[position / 64] >> (position % 64) & 1)) continue;
+            while(taken[hole / 64] >> (hole % 64) & 1) hole++;
+            remap[position - n] = static_cast<uint32_t>(hole++);
+        }
+        for(uint64_t i = 0; i < n; i++) {
+            uint64_t index = slot_for(hashes[i]);
+            data[index].key = keys[i];
+            data[index].value = values[i];
+        }
+        return true;
+    }
+
+    // assumes key is in the map
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        uint64_t index = index_for(key);
+        return find_indexed(key, index, steps);
+    }
+
+    bool contains(uint64_t key, uint64_t*) {
+        if(size_ == 0) return false;
+        return data[index_for(key)].key == key;
+    }
+
+    void clear() {
+        __aligned_free(pilots);
+        __aligned_free(remap);
+        __aligned_free(data);
+        pilots = remap = nullptr;
+        data = nullptr;
+        size_ = buckets = positions = 0;
+    }
+
+    uint64_t slot_for(uint64_t hash) {
+        uint64_t position = position_for(hash, pilots[bucket_for(hash)]);
+        return position < size_ ? position : remap[position - size_];
+    }
+    uint64_t index_for(uint64_t key) { return slot_for(Hash{}(key)); }
+    // the pilot array is small enough to stay cached, so only the slot is worth fetching
+    uint64_t prefetch(uint64_t key) {
+        uint64_t index = index_for(key);
+        ::prefetch(&data[index]);
+        return index;
+    }
+    uint64_t find_indexed(uint64_t, uint64_t index, uint64_t*) { return data[index].value; }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() {
+        return 4 * (buckets + positions - size_) + sizeof(Slot) * size_ + sizeof(Perfect);
+    }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < size_; i++) sum += data[i].value;
+        return sum;
+    }
+
+    struct Slot {
+        uint64_t key, value;
+    };
+    uint32_t* pilots;
+    // remap[i] is the slot for position n + i
+    uint32_t* remap;
+    Slot* data;
+    uint64_t buckets;
+    // the range pilots place keys in, n / ALPHA
+    uint64_t positions;
+    uint64_t size_;
+};
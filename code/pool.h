@@ -0,0 +1,104 @@
+#pragma once
+
+#include <utility>
+
+#include "base.h"
+
+// Hands out fixed-size nodes from cache-line-aligned chunks. Freed nodes go on a free list,
+// and clear() rewinds to the first chunk without returning any memory to the system.
+template<typename T>
+struct Pool {
+
+    static constexpr uint64_t CHUNK = 64 * 1024;
+    static constexpr uint64_t PER_CHUNK = (CHUNK - CACHE_LINE) / sizeof(T);
+    static_assert(sizeof(T) >= sizeof(void*));
+
+    Pool() {
+        chunks = 0;
+        first = current = nullptr;
+        next = end = nullptr;
+        free_list = nullptr;
+    }
+    ~Pool() {
+        while(first) {
+            Chunk* chunk = first->next;
+            __aligned_free(first);
+            first = chunk;
+        }
+    }
+
+    T* alloc() {
+        if(free_list) {
+            T* node = reinterpret_cast<T*>(free_list);
+            free_list = free_list->next;
+            return node;
+        }
+        if(next == end) {
+            Chunk* chunk = current ? current->next : first;
+            if(!chunk) {
+                chunk = reinterpret_cast<Chunk*>(__aligned_alloc(CACHE_LINE, CHUNK));
+                chunk->next = nullptr;
+                if(current)
+                    current->next = chunk;
+                else
+                    first = chunk;
+                chunks++;
+            }
+            current = chunk;
+            next = reinterpret_cast<T*>(reinterpret_cast<char*>(chunk) + CACHE_LINE);
+            end = next + PER_CHUNK;
+        }
+        return next++;
+    }
+
+    // makes sure the chunks hold at least n nodes in all, so the first n allocations after
+    // construction or a clear() never go to the system
+    void reserve(uint64_t n) {
+        Chunk** link = &first;
+        for(uint64_t i = 0; i < (n + PER_CHUNK - 1) / PER_CHUNK; i++) {
+            if(!*link) {
+                *link = reinterpret_cast<Chunk*>(__aligned_alloc(CACHE_LINE, CHUNK));
+                (*link)->next = nullptr;
+                chunks++;
+            }
+            link = &(*link)->next;
+        }
+    }
+
+    void free(T* node) {
+        Free* f = reinterpret_cast<Free*>(node);
+        f->next = free_list;
+        free_list = f;
+    }
+
+    void clear() {
+        current = nullptr;
+        next = end = nullptr;
+        free_list = nullptr;
+    }
+
+    void swap(Pool& other) {
+        std::swap(first, other.first);
+        std::swap(current, other.current);
+        std::swap(next, other.next);
+        std::swap(end, other.end);
+        std::swap(free_list, other.free_list);
+        std::swap(chunks, other.chunks);
+    }
+
+    uint64_t memory_usage() { return chunks * CHUNK; }
+
+    // the first cache line of each chunk only holds the link to the next one
+    struct Chunk {
+        Chunk* next;
+    };
+    struct Free {
+        Free* next;
+    };
+    Chunk* first;
+    Chunk* current;
+    T* next;
+    T* end;
+    Free* free_list;
+    uint64_t chunks;
+};
@@ -1,27 +1,34 @@
 #pragma once
 
 #include "base.h"
+#include "bulk.h"
 
-template<uint64_t LF_, uint64_t DF_>
+template<uint64_t LF_, uint64_t DF_, typename Hash = Squirrel3_Hash>
 struct Quadratic {
 
+    struct Slot;
+
     static constexpr uint64_t EMPTY = UINT64_MAX;
     static constexpr uint64_t DELETED = UINT64_MAX - 1;
     static constexpr double LF = static_cast<double>(LF_) / 100.0;
     static constexpr double DF = static_cast<double>(DF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
 
     Quadratic() {
         size_ = 0;
         capacity = 8;
+        min_load = LF * SHRINK_LOAD;
         deleted_ = 0;
+        grow_threads = 1;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
     }
+    explicit Quadratic(uint64_t n) : Quadratic() { reserve(n); }
     ~Quadratic() { __aligned_free(data); }
 
     void insert(uint64_t key, uint64_t value) {
         if(size_ >= capacity * LF) grow();
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1), dist = 0;
         while(data[index].key < DELETED) {
             dist++;
@@ -33,7 +40,7 @@ struct Quadratic {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1), dist = 0;
         for(;;) {
             if(data[index].key == key) {
@@ -46,7 +53,7 @@ struct Quadratic {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1), dist = 0;
         while(data[index].key < EMPTY) {
             if(dist++ == capacity) return false;
@@ -58,14 +65,17 @@ struct Quadratic {
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1), dist = 0;
         for(;;) {
             if(data[index].key == key) {
                 data[index].key = DELETED;
                 size_--;
                 deleted_++;
-                if(deleted_ >= capacity * DF) rehash();
+                if(size_ < capacity * min_load && capacity > 8)
+                    resize(capacity / 2);
+                else if(deleted_ >= capacity * DF)
+                    rehash();
                 return;
             }
             dist++;
@@ -75,30 +85,64 @@ struct Quadratic {
 
     void rehash() {
         Slot* old_data = data;
-        size_ = 0;
         deleted_ = 0;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
-        for(uint64_t i = 0; i < capacity; i++) {
-            if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
-        }
+        move_from(old_data, capacity);
         __aligned_free(old_data);
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot* old_data = data;
-        size_ = 0;
-        capacity *= 2;
+        capacity = new_capacity;
         deleted_ = 0;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
-        for(uint64_t i = 0; i < old_capacity; i++) {
-            if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
-        }
+        move_from(old_data, old_capacity);
         __aligned_free(old_data);
     }
 
+    // reinserts the pairs from an old array into the freshly cleared one, with claim_fill() if
+    // grow_threads is set (see bulk.h); that path leaves size_ as it is
+    void move_from(Slot* old_data, uint64_t old_capacity) {
+        if(grow_threads == 1) {
+            size_ = 0;
+            for(uint64_t i = 0; i < old_capacity; i++) {
+                if(old_data[i].key < DELETED) insert(old_data[i].key, old_data[i].value);
+            }
+            return;
+        }
+        ::claim_fill(
+            old_capacity, grow_threads,
+            [old_data](uint64_t i, uint64_t& key, uint64_t& value) {
+                key = old_data[i].key;
+                value = old_data[i].value;
+                return key < DELETED;
+            },
+            [this](uint64_t key, uint64_t&) { return index_for(key); },
+            [this](uint64_t index, uint64_t, uint64_t dist) {
+                return (index + dist) & (capacity - 1);
+            },
+            [this](uint64_t index, uint64_t key, uint64_t value) {
+                if(!::claim(data[index].key, EMPTY, key)) return false;
+                data[index].value = value;
+                return true;
+            });
+    }
+
     void clear() {
         size_ = 0;
         deleted_ = 0;
@@ -106,7 +150,7 @@ struct Quadratic {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         return index;
     }
@@ -127,6 +171,34 @@ struct Quadratic {
         }
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // one lookup for find_amac(): each step checks one slot of the probe sequence
+    struct Probe {
+        uint64_t key, index, dist, value;
+    };
+    void probe_start(Probe& p, uint64_t key) {
+        p.key = key;
+        p.index = prefetch(key);
+        p.dist = 0;
+    }
+    bool probe_step(Probe& p) {
+        if(data[p.index].key == p.key) {
+            p.value = data[p.index].value;
+            return true;
+        }
+        p.dist++;
+        p.index = (p.index + p.dist) & (capacity - 1);
+        ::prefetch(&data[p.index]);
+        return false;
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Quadratic); }
@@ -146,4 +218,7 @@ struct Quadratic {
     uint64_t capacity;
     uint64_t size_;
     uint64_t deleted_;
+    // threads grow() and rehash() move pairs with; 1 keeps the serial insert loop
+    uint64_t grow_threads;
+    double min_load;
 };
\ No newline at end of file
@@ -1,26 +1,34 @@
 #pragma once
 
 #include "base.h"
+#include "bulk.h"
+#include "snapshot.h"
 
-template<uint64_t LF_>
+template<uint64_t LF_, typename Alloc = Aligned_Alloc, typename Hash = Squirrel3_Hash>
 struct Robin_Hood {
 
     static constexpr uint64_t EMPTY = UINT64_MAX;
     static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    static constexpr uint64_t BATCH = 16;
 
     Robin_Hood() {
         size_ = 0;
         max_probe = 0;
         capacity = 8;
-        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        min_load = LF * SHRINK_LOAD;
+        mapped = nullptr;
+        mapped_bytes = 0;
+        grow_threads = 1;
+        data = reinterpret_cast<Slot*>(Alloc::alloc(sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
     }
-    ~Robin_Hood() { __aligned_free(data); }
+    explicit Robin_Hood(uint64_t n) : Robin_Hood() { reserve(n); }
+    ~Robin_Hood() { release(data, capacity); }
 
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
         if(size_ >= capacity * LF) grow();
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t dist = 0;
         size_++;
@@ -45,7 +53,7 @@ struct Robin_Hood {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t dist = 0;
         for(;;) {
@@ -57,7 +65,7 @@ struct Robin_Hood {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         uint64_t dist = 0;
         while(dist <= max_probe) {
@@ -70,29 +78,79 @@ struct Robin_Hood {
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         for(;;) {
             if(data[index].key == key) {
                 data[index].key = EMPTY;
                 size_--;
+                if(size_ < capacity * min_load && capacity > 8) resize(capacity / 2);
                 return;
             }
             index = (index + 1) & (capacity - 1);
         }
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot* old_data = data;
         size_ = 0;
-        capacity *= 2;
-        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        capacity = new_capacity;
+        data = reinterpret_cast<Slot*>(Alloc::alloc(sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
-        for(uint64_t i = 0; i < old_capacity; i++) {
-            if(old_data[i].key < EMPTY) insert(old_data[i].key, old_data[i].value);
+        if(grow_threads > 1) {
+            fill(old_capacity, grow_threads,
+                 [old_data](uint64_t i, uint64_t& key, uint64_t& value) {
+                     key = old_data[i].key;
+                     value = old_data[i].value;
+                     return key < EMPTY;
+                 });
+        } else {
+            for(uint64_t i = 0; i < old_capacity; i++) {
+                if(old_data[i].key < EMPTY) insert(old_data[i].key, old_data[i].value);
+            }
         }
-        __aligned_free(old_data);
+        release(old_data, old_capacity);
+    }
+
+    // replaces the contents with n distinct keys: sizes the table once, then fills it from
+    // several threads (see bulk.h)
+    void bulk_build(const uint64_t* keys, const uint64_t* values, uint64_t n) {
+        release(data, capacity);
+        capacity = capacity_for(n, LF);
+        data = reinterpret_cast<Slot*>(Alloc::alloc(sizeof(Slot) * capacity));
+        std::memset(data, 0xff, sizeof(Slot) * capacity);
+        fill(n, hardware_threads(), [keys, values](uint64_t i, uint64_t& key, uint64_t& value) {
+            key = keys[i];
+            value = values[i];
+            return true;
+        });
+    }
+
+    // moves the pairs from source (see bulk.h) into the freshly cleared array on threads
+    template<typename Source>
+    void fill(uint64_t n, uint64_t threads, Source source) {
+        Bulk_Result result = ::bulk_fill(
+            n, capacity, threads, source, [this](uint64_t key) { return index_for(key); },
+            [this](uint64_t index, uint64_t key, uint64_t value) {
+                data[index].key = key;
+                data[index].value = value;
+            });
+        size_ = result.placed;
+        max_probe = result.max_dist;
+        for(auto [key, value] : result.overflow) insert(key, value);
     }
 
     void clear() {
@@ -102,7 +160,7 @@ struct Robin_Hood {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index = hash & (capacity - 1);
         return index;
     }
@@ -121,6 +179,59 @@ struct Robin_Hood {
         }
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // one lookup for find_amac(): each step scans the rest of a prefetched line
+    struct Probe {
+        uint64_t key, index, value;
+    };
+    void probe_start(Probe& p, uint64_t key) {
+        p.key = key;
+        p.index = prefetch(key);
+    }
+    bool probe_step(Probe& p) {
+        constexpr uint64_t LINE = CACHE_LINE / sizeof(Slot);
+        do {
+            if(data[p.index].key == p.key) {
+                p.value = data[p.index].value;
+                return true;
+            }
+            p.index = (p.index + 1) & (capacity - 1);
+        } while(p.index % LINE != 0);
+        ::prefetch(&data[p.index]);
+        return false;
+    }
+
+    // see snapshot.h; a loaded table reads from the mapping until it next grows
+    bool save(const char* path) {
+        const void* arrays[] = {data};
+        return Snapshot::save<Hash>(path, "robin_hood", capacity, size_, max_probe, arrays,
+                                    {sizeof(Slot)});
+    }
+    bool load_mmap(const char* path) {
+        Snapshot::Header header;
+        uint64_t length = 0;
+        void* base = Snapshot::map<Hash>(path, "robin_hood", {sizeof(Slot)}, header, length);
+        if(!base) return false;
+        release(data, capacity);
+        mapped = base;
+        mapped_bytes = length;
+        data = Snapshot::array<Slot>(base, header, 0);
+        capacity = header.capacity;
+        size_ = header.size;
+        max_probe = header.extra;
+        return true;
+    }
+    void release(void* old_data, uint64_t old_capacity) {
+        Snapshot::release<Alloc>(mapped, mapped_bytes, old_data, sizeof(Slot) * old_capacity);
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Robin_Hood); }
@@ -140,4 +251,10 @@ struct Robin_Hood {
     uint64_t capacity;
     uint64_t size_;
     uint64_t max_probe;
+    // the snapshot the arrays live in, if loaded with load_mmap()
+    void* mapped;
+    uint64_t mapped_bytes;
+    // threads grow() rehashes with; 1 keeps the serial insert loop
+    uint64_t grow_threads;
+    double min_load;
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <functional>
+#include <new>
+#include <type_traits>
+
+#include "base.h"
+
+// like Swiss, only the metadata marks empty slots, so K and V may be any movable types
+template<uint64_t LF_, typename Hash = Squirrel3_Hash, typename K = uint64_t, typename V = uint64_t,
+         typename Eq = std::equal_to<K>>
+struct Robin_Hood_With_Metadata {
+
+    // dists[i] is zero for an empty slot, otherwise the probe distance plus one; the first
+    // MIRROR bytes are repeated past the end so a vector load never has to wrap around
+    static constexpr uint64_t MIRROR = 32;
+    static constexpr uint64_t MAX_DIST = 254;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    // prefetch() touches two lines per key
+    static constexpr uint64_t BATCH = 8;
+
+    Robin_Hood_With_Metadata() {
+        size_ = 0;
+        capacity = MIRROR;
+        min_load = LF * SHRINK_LOAD;
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        dists = reinterpret_cast<uint8_t*>(__aligned_alloc(CACHE_LINE, capacity + MIRROR));
+        std::memset(dists, 0, capacity + MIRROR);
+    }
+    explicit Robin_Hood_With_Metadata(uint64_t n) : Robin_Hood_With_Metadata() { reserve(n); }
+    ~Robin_Hood_With_Metadata() {
+        destroy();
+        __aligned_free(data);
+        __aligned_free(dists);
+    }
+
+    void set_dist(uint64_t index, uint8_t dist) {
+        dists[index] = dist;
+        if(index < MIRROR) dists[capacity + index] = dist;
+    }
+
+    // destructs every full slot, a no-op for trivial types
+    void destroy() {
+        if constexpr(!std::is_trivially_destructible_v<Slot>) {
+            for(uint64_t i = 0; i < capacity; i++) {
+                if(dists[i]) data[i].~Slot();
+            }
+        }
+    }
+
+    // assumes key is not in the map
+    void insert(K key, V value) {
+        if(size_ >= capacity * LF) grow();
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        uint64_t dist = 0;
+        for(;;) {
+            uint64_t cur = dists[index];
+            if(cur == 0) {
+                new(&data[index]) Slot{std::move(key), std::move(value)};
+                set_dist(index, static_cast<uint8_t>(dist + 1));
+                size_++;
+                return;
+            }
+            if(cur - 1 < dist) {
+                std::swap(key, data[index].key);
+                std::swap(value, data[index].value);
+                set_dist(index, static_cast<uint8_t>(dist + 1));
+                dist = cur - 1;
+            }
+            dist++;
+            if(dist > MAX_DIST) {
+                grow();
+                insert(std::move(key), std::move(value));
+                return;
+            }
+            index = (index + 1) & (capacity - 1);
+        }
+    }
+
+    V find(const K& key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        return find_indexed(key, index, steps);
+    }
+
+    bool contains(const K& key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        __m256i expected = _mm256_setr_epi8(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                                            17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                            30, 31, 32);
+        for(;;) {
+            __m256i test = _mm256_loadu_si256(reinterpret_cast<__m256i*>(&dists[index]));
+            // a key can only sit where the stored distance equals its own, and the probe ends
+            // at the first slot that is empty or closer to home than we are
+            uint32_t same = _mm256_movemask_epi8(_mm256_cmpeq_epi8(test, expected));
+            uint32_t stop = ~static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(_mm256_max_epu8(test, expected), test)));
+            if(stop) same &= (stop & (0 - stop)) - 1;
+            while(same) {
+                uint64_t i = (index + __ctz(same)) & (capacity - 1);
+                if(Eq{}(data[i].key, key)) return true;
+                (*steps)++;
+                same &= same - 1;
+            }
+            if(stop) return false;
+            index = (index + MIRROR) & (capacity - 1);
+            expected = _mm256_adds_epu8(expected, _mm256_set1_epi8(MIRROR));
+        }
+    }
+
+    void erase(const K& key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        for(;;) {
+            if(dists[index] && Eq{}(data[index].key, key)) {
+                size_--;
+                remove(index);
+                if(size_ < capacity * min_load && capacity > MIRROR) resize(capacity / 2);
+                return;
+            }
+            index = (index + 1) & (capacity - 1);
+        }
+    }
+
+    void remove(uint64_t index) {
+        for(;;) {
+            uint64_t next = (index + 1) & (capacity - 1);
+            if(dists[next] <= 1) {
+                data[index].~Slot();
+                set_dist(index, 0);
+                return;
+            }
+            data[index] = std::move(data[next]);
+            set_dist(index, dists[next] - 1);
+            index = next;
+        }
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF, MIRROR);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF, MIRROR);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
+        uint64_t old_capacity = capacity;
+        Slot* old_data = data;
+        uint8_t* old_dists = dists;
+        size_ = 0;
+        capacity = new_capacity;
+        data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
+        dists = reinterpret_cast<uint8_t*>(__aligned_alloc(CACHE_LINE, capacity + MIRROR));
+        std::memset(dists, 0, capacity + MIRROR);
+        for(uint64_t i = 0; i < old_capacity; i++) {
+            if(old_dists[i]) {
+                insert(std::move(old_data[i].key), std::move(old_data[i].value));
+                old_data[i].~Slot();
+            }
+        }
+        __aligned_free(old_data);
+        __aligned_free(old_dists);
+    }
+
+    void clear() {
+        destroy();
+        size_ = 0;
+        std::memset(dists, 0, capacity + MIRROR);
+    }
+
+    uint64_t index_for(const K& key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t index = hash & (capacity - 1);
+        return index;
+    }
+    uint64_t prefetch(const K& key) {
+        uint64_t index = index_for(key);
+        ::prefetch(&dists[index]);
+        ::prefetch(&data[index]);
+        return index;
+    }
+    V find_indexed(const K& key, uint64_t index, uint64_t* steps) {
+        __m256i expected = _mm256_setr_epi8(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                                            17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29,
+                                            30, 31, 32);
+        for(;;) {
+            __m256i test = _mm256_loadu_si256(reinterpret_cast<__m256i*>(&dists[index]));
+            uint32_t same = _mm256_movemask_epi8(_mm256_cmpeq_epi8(test, expected));
+            while(same) {
+                uint64_t i = (index + __ctz(same)) & (capacity - 1);
+                if(Eq{}(data[i].key, key)) return data[i].value;
+                (*steps)++;
+                same &= same - 1;
+            }
+            index = (index + MIRROR) & (capacity - 1);
+            expected = _mm256_adds_epu8(expected, _mm256_set1_epi8(MIRROR));
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const K* keys, size_t n, V* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const K* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() {
+        return (sizeof(Slot) + 1) * capacity + MIRROR + sizeof(Robin_Hood_With_Metadata);
+    }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < capacity; i++) {
+            if(dists[i]) sum += data[i].value;
+        }
+        return sum;
+    }
+
+    struct Slot {
+        K key;
+        V value;
+    };
+    Slot* data;
+    uint8_t* dists;
+    uint64_t capacity;
+    uint64_t size_;
+    double min_load;
+};
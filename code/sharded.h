@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+
+#include "base.h"
+
+// Reader-writer spinlock. A writer first sets the writer bit, which stops new readers from
+// getting in, then waits for the readers already inside to leave.
+struct RW_Spinlock {
+
+    static constexpr uint32_t WRITER = 1u << 31;
+
+    void lock_shared() {
+        for(;;) {
+            uint32_t state = lock_.load(std::memory_order_relaxed);
+            if(!(state & WRITER) &&
+               lock_.compare_exchange_weak(state, state + 1, std::memory_order_acquire))
+                return;
+            _mm_pause();
+        }
+    }
+    void unlock_shared() { lock_.fetch_sub(1, std::memory_order_release); }
+
+    void lock() {
+        for(;;) {
+            uint32_t state = lock_.load(std::memory_order_relaxed);
+            if(!(state & WRITER) &&
+               lock_.compare_exchange_weak(state, state | WRITER, std::memory_order_acquire))
+                break;
+            _mm_pause();
+        }
+        while(lock_.load(std::memory_order_acquire) != WRITER) _mm_pause();
+    }
+    void unlock() { lock_.store(0, std::memory_order_release); }
+
+    std::atomic<uint32_t> lock_{0};
+};
+
+// Routes each key by the top bits of its hash to one of SHARDS independent maps, each behind
+// its own lock, so a grow() only stalls the keys of one shard. Given the same Hash, the inner
+// maps see the low bits of the same hash, which stay independent of the routing bits.
+//
+// Unlike the inner maps, insert() overwrites an existing key and erase() ignores a missing
+// one, since concurrent callers cannot know what the others have done.
+template<typename Map, uint64_t SHARDS, typename Hash = Squirrel3_Hash>
+struct Sharded {
+
+    static_assert((SHARDS & (SHARDS - 1)) == 0);
+    static constexpr uint64_t SHIFT = 64 - std::countr_zero(SHARDS);
+    static constexpr uint64_t BATCH = 16;
+
+    struct Shard;
+
+    Sharded() = default;
+    explicit Sharded(uint64_t n) { reserve(n); }
+
+    Shard& shard_for(uint64_t key) {
+        if constexpr(SHARDS == 1)
+            return shards[0];
+        else
+            return shards[Hash{}(key) >> SHIFT];
+    }
+
+    void insert(uint64_t key, uint64_t value) {
+        Shard& s = shard_for(key);
+        uint64_t steps = 0;
+        s.lock.lock();
+        if(s.map.contains(key, &steps)) s.map.erase(key);
+        s.map.insert(key, value);
+        s.lock.unlock();
+    }
+
+    uint64_t find(uint64_t key, uint64_t* steps) {
+        Shard& s = shard_for(key);
+        s.lock.lock_shared();
+        uint64_t value = s.map.find(key, steps);
+        s.lock.unlock_shared();
+        return value;
+    }
+
+    bool contains(uint64_t key, uint64_t* steps) {
+        Shard& s = shard_for(key);
+        s.lock.lock_shared();
+        bool found = s.map.contains(key, steps);
+        s.lock.unlock_shared();
+        return found;
+    }
+
+    void erase(uint64_t key) {
+        Shard& s = shard_for(key);
+        uint64_t steps = 0;
+        s.lock.lock();
+        if(s.map.contains(key, &steps)) s.map.erase(key);
+        s.lock.unlock();
+    }
+
+    void clear() {
+        for(uint64_t i = 0; i < SHARDS; i++) {
+            shards[i].lock.lock();
+            shards[i].map.clear();
+            shards[i].lock.unlock();
+        }
+    }
+
+    // the routing spreads keys evenly, and the power-of-two capacities leave slack for the
+    // shards that get a few more than their share
+    void reserve(uint64_t n) {
+        for(uint64_t i = 0; i < SHARDS; i++) {
+            shards[i].lock.lock();
+            shards[i].map.reserve((n + SHARDS - 1) / SHARDS);
+            shards[i].lock.unlock();
+        }
+    }
+
+    void shrink_to_fit() {
+        for(uint64_t i = 0; i < SHARDS; i++) {
+            shards[i].lock.lock();
+            shards[i].map.shrink_to_fit();
+            shards[i].lock.unlock();
+        }
+    }
+
+    uint64_t index_for(uint64_t key) { return key; }
+    // the shard can grow between prefetch() and find_indexed(), so only the cache lines are
+    // carried over and find_indexed() looks the key up again
+    uint64_t prefetch(uint64_t key) {
+        Shard& s = shard_for(key);
+        s.lock.lock_shared();
+        s.map.prefetch(key);
+        s.lock.unlock_shared();
+        return key;
+    }
+    uint64_t find_indexed(uint64_t key, uint64_t, uint64_t* steps) { return find(key, steps); }
+
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() {
+        uint64_t size = 0;
+        for(uint64_t i = 0; i < SHARDS; i++) {
+            shards[i].lock.lock_shared();
+            size += shards[i].map.size();
+            shards[i].lock.unlock_shared();
+        }
+        return size;
+    }
+
+    uint64_t memory_usage() {
+        uint64_t memory = sizeof(Sharded);
+        for(uint64_t i = 0; i < SHARDS; i++) {
+            shards[i].lock.lock_shared();
+            memory += shards[i].map.memory_usage() - sizeof(Map);
+            shards[i].lock.unlock_shared();
+        }
+        return memory;
+    }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t i = 0; i < SHARDS; i++) {
+            shards[i].lock.lock_shared();
+            sum += shards[i].map.sum_all_values();
+            shards[i].lock.unlock_shared();
+        }
+        return sum;
+    }
+
+    struct alignas(CACHE_LINE) Shard {
+        RW_Spinlock lock;
+        Map map;
+    };
+    Shard shards[SHARDS];
+};
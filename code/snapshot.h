@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstdio>
+
+#include "base.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// On-disk image of a flat-array table: a header page, then each of the table's arrays starting
+// on its own page, byte for byte as they sit in memory. load_mmap() maps the file privately, so
+// lookups can start right away and fault pages in as they are touched, nothing is rehashed, and
+// writes to a loaded table only copy the pages they touch. Snapshots are only readable on a
+// machine with the same endianness and slot layout, and only with the same hash.
+struct Snapshot {
+
+    static constexpr char MAGIC[8] = {'H', 'T', 'S', 'N', 'A', 'P', '\0', '\0'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t PAGE = 4096;
+    static constexpr uint64_t MAX_ARRAYS = 2;
+    // the header stores what the table's hash makes of this, to catch a mismatched Hash
+    static constexpr uint64_t HASH_PROBE = 0x0123456789ABCDEFULL;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t arrays;
+        char table[16];
+        uint64_t hash;
+        uint64_t capacity;
+        uint64_t size;
+        // anything else the table needs, e.g. Robin_Hood's max_probe
+        uint64_t extra;
+        uint64_t offsets[MAX_ARRAYS];
+        uint64_t bytes[MAX_ARRAYS];
+    };
+
+    // offsets are assigned by save()
+    template<typename Hash, size_t N>
+    static Header header(const char* table, uint64_t capacity, uint64_t size, uint64_t extra,
+                         const uint64_t (&slot_bytes)[N]) {
+        static_assert(N <= MAX_ARRAYS);
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.arrays = N;
+        std::strncpy(header.table, table, sizeof(header.table) - 1);
+        header.hash = Hash{}(HASH_PROBE);
+        header.capacity = capacity;
+        header.size = size;
+        header.extra = extra;
+        for(size_t i = 0; i < N; i++) header.bytes[i] = capacity * slot_bytes[i];
+        return header;
+    }
+
+    // whether ptr points into the mapping at base; a grow() may free arrays from either place
+    static bool owns(const void* base, uint64_t length, const void* ptr) {
+        const char* begin = static_cast<const char*>(base);
+        const char* p = static_cast<const char*>(ptr);
+        return base && p >= begin && p < begin + length;
+    }
+
+    // frees an array of the given size that came from Alloc, or unmaps the snapshot it was
+    // loaded from
+    template<typename Alloc>
+    static void release(void*& mapped, uint64_t length, void* ptr, size_t size) {
+        if(owns(mapped, length, ptr)) {
+            unmap(mapped, length);
+            mapped = nullptr;
+        } else {
+            Alloc::free(ptr, size);
+        }
+    }
+
+    static uint64_t round(uint64_t bytes) { return (bytes + PAGE - 1) & ~(PAGE - 1); }
+
+    // array i of the table holds capacity slots of slot_bytes[i]
+    template<typename Hash, size_t N>
+    static bool save(const char* path, const char* table, uint64_t capacity, uint64_t size,
+                     uint64_t extra, const void* const (&arrays)[N],
+                     const uint64_t (&slot_bytes)[N]) {
+        Header header = Snapshot::header<Hash>(table, capacity, size, extra, slot_bytes);
+        uint64_t offset = PAGE;
+        for(uint32_t i = 0; i < header.arrays; i++) {
+            header.offsets[i] = offset;
+            offset += round(header.bytes[i]);
+        }
+        std::FILE* file = std::fopen(path, "wb");
+        if(!file) return false;
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        for(uint32_t i = 0; ok && i < header.arrays; i++) {
+            ok = std::fseek(file, static_cast<long>(header.offsets[i]), SEEK_SET) == 0 &&
+                 std::fwrite(arrays[i], 1, header.bytes[i], file) == header.bytes[i];
+        }
+        return std::fclose(file) == 0 && ok;
+    }
+
+    // where array i of a mapped snapshot starts
+    template<typename T>
+    static T* array(void* base, const Header& header, uint32_t i) {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + header.offsets[i]);
+    }
+
+#ifdef _WIN32
+    template<typename Hash, size_t N>
+    static void* map(const char*, const char*, const uint64_t (&)[N], Header&, uint64_t&) {
+        return nullptr;
+    }
+    static void unmap(void*, uint64_t) {}
+#else
+    // Maps the file if its header has this table, hash and array count, and each array i
+    // holds capacity slots of slot_bytes[i]. On success fills in the header from the file;
+    // otherwise returns nullptr.
+    template<typename Hash, size_t N>
+    static void* map(const char* path, const char* table, const uint64_t (&slot_bytes)[N],
+                     Header& header, uint64_t& length) {
+        header = Snapshot::header<Hash>(table, 0, 0, 0, slot_bytes);
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0) return nullptr;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) < PAGE) {
+            ::close(fd);
+            return nullptr;
+        }
+        length = static_cast<uint64_t>(st.st_size);
+        void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(base == MAP_FAILED) return nullptr;
+
+        const Header& found = *reinterpret_cast<const Header*>(base);
+        bool ok = std::memcmp(found.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                  found.version == VERSION && found.arrays == header.arrays &&
+                  std::memcmp(found.table, header.table, sizeof(found.table)) == 0 &&
+                  found.hash == header.hash && found.capacity > 0 &&
+                  (found.capacity & (found.capacity - 1)) == 0;
+        for(uint32_t i = 0; ok && i < found.arrays; i++) {
+            ok = found.bytes[i] == found.capacity * slot_bytes[i] &&
+                 found.offsets[i] % PAGE == 0 && found.offsets[i] + found.bytes[i] <= length;
+        }
+        if(!ok) {
+            munmap(base, length);
+            return nullptr;
+        }
+        header = found;
+        return base;
+    }
+    static void unmap(void* base, uint64_t length) { munmap(base, length); }
+#endif
+};
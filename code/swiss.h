@@ -0,0 +1,245 @@
+#pragma once
+
+#include <functional>
+#include <new>
+#include <type_traits>
+
+#include "base.h"
+
+// emptiness lives entirely in the control bytes, so K and V can be anything movable; slots are
+// constructed on insert and destroyed on erase, and grow() moves them rather than copying
+template<uint64_t LF_, typename Alloc = Aligned_Alloc, typename Hash = Squirrel3_Hash,
+         typename K = uint64_t, typename V = uint64_t, typename Eq = std::equal_to<K>>
+struct Swiss {
+
+    // one control byte per slot: the low 7 hash bits if full, otherwise one of these
+    // (both have the high bit set, so movemask of the raw control bytes finds free slots)
+    static constexpr uint8_t EMPTY = 0x80;
+    static constexpr uint8_t DELETED = 0xfe;
+    static constexpr uint64_t GROUP = 32;
+    static constexpr double LF = static_cast<double>(LF_) / 100.0;
+    // prefetch() touches two lines per key
+    static constexpr uint64_t BATCH = 8;
+
+    Swiss() {
+        size_ = deleted_ = 0;
+        capacity = GROUP;
+        min_load = LF * SHRINK_LOAD;
+        ctrl = reinterpret_cast<uint8_t*>(Alloc::alloc(capacity));
+        data = reinterpret_cast<Slot*>(Alloc::alloc(sizeof(Slot) * capacity));
+        std::memset(ctrl, EMPTY, capacity);
+    }
+    explicit Swiss(uint64_t n) : Swiss() { reserve(n); }
+    ~Swiss() {
+        destroy();
+        Alloc::free(ctrl, capacity);
+        Alloc::free(data, sizeof(Slot) * capacity);
+    }
+
+    static uint64_t h1(uint64_t hash) { return hash >> 7; }
+    static uint8_t h2(uint64_t hash) { return static_cast<uint8_t>(hash & 0x7f); }
+
+    uint32_t match(uint64_t group, uint8_t byte) {
+        __m256i test = _mm256_load_si256(reinterpret_cast<__m256i*>(&ctrl[group]));
+        __m256i cmp = _mm256_cmpeq_epi8(test, _mm256_set1_epi8(static_cast<char>(byte)));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(cmp));
+    }
+    uint32_t match_free(uint64_t group) {
+        __m256i test = _mm256_load_si256(reinterpret_cast<__m256i*>(&ctrl[group]));
+        return static_cast<uint32_t>(_mm256_movemask_epi8(test));
+    }
+
+    // destructs every full slot, a no-op for trivial types
+    void destroy() {
+        if constexpr(!std::is_trivially_destructible_v<Slot>) {
+            for(uint64_t i = 0; i < capacity; i++) {
+                if(!(ctrl[i] & 0x80)) data[i].~Slot();
+            }
+        }
+    }
+
+    // assumes key is not in the map
+    void insert(K key, V value) {
+        if(size_ >= capacity * LF)
+            grow();
+        else if(size_ + deleted_ >= capacity * LF)
+            rehash();
+        uint64_t hash = Hash{}(key);
+        uint64_t group = h1(hash) & (capacity - 1) & ~(GROUP - 1);
+        for(;;) {
+            uint32_t mask = match_free(group);
+            if(mask) {
+                uint64_t index = group + __ctz(mask);
+                if(ctrl[index] == DELETED) deleted_--;
+                ctrl[index] = h2(hash);
+                new(&data[index]) Slot{std::move(key), std::move(value)};
+                size_++;
+                return;
+            }
+            group = (group + GROUP) & (capacity - 1);
+        }
+    }
+
+    V find(const K& key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        return find_indexed(key, hash, steps);
+    }
+
+    bool contains(const K& key, uint64_t* steps) {
+        uint64_t hash = Hash{}(key);
+        uint64_t group = h1(hash) & (capacity - 1) & ~(GROUP - 1);
+        for(uint64_t dist = 0; dist < capacity; dist += GROUP) {
+            uint32_t mask = match(group, h2(hash));
+            while(mask) {
+                uint64_t index = group + __ctz(mask);
+                if(Eq{}(data[index].key, key)) return true;
+                mask &= mask - 1;
+            }
+            if(match(group, EMPTY)) return false;
+            (*steps)++;
+            group = (group + GROUP) & (capacity - 1);
+        }
+        return false;
+    }
+
+    void erase(const K& key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t group = h1(hash) & (capacity - 1) & ~(GROUP - 1);
+        for(;;) {
+            uint32_t mask = match(group, h2(hash));
+            while(mask) {
+                uint64_t index = group + __ctz(mask);
+                if(Eq{}(data[index].key, key)) {
+                    data[index].~Slot();
+                    // if this group still has an empty slot, no probe sequence has ever
+                    // continued past it, so the slot can go straight back to empty
+                    if(match(group, EMPTY)) {
+                        ctrl[index] = EMPTY;
+                    } else {
+                        ctrl[index] = DELETED;
+                        deleted_++;
+                    }
+                    size_--;
+                    if(size_ < capacity * min_load && capacity > GROUP) resize(capacity / 2);
+                    return;
+                }
+                mask &= mask - 1;
+            }
+            group = (group + GROUP) & (capacity - 1);
+        }
+    }
+
+    void rehash() {
+        Slot* old_data = data;
+        uint8_t* old_ctrl = ctrl;
+        size_ = deleted_ = 0;
+        ctrl = reinterpret_cast<uint8_t*>(Alloc::alloc(capacity));
+        data = reinterpret_cast<Slot*>(Alloc::alloc(sizeof(Slot) * capacity));
+        std::memset(ctrl, EMPTY, capacity);
+        for(uint64_t i = 0; i < capacity; i++) {
+            if(!(old_ctrl[i] & 0x80)) {
+                insert(std::move(old_data[i].key), std::move(old_data[i].value));
+                old_data[i].~Slot();
+            }
+        }
+        Alloc::free(old_ctrl, capacity);
+        Alloc::free(old_data, sizeof(Slot) * capacity);
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, LF, GROUP);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, LF, GROUP);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
+        uint64_t old_capacity = capacity;
+        Slot* old_data = data;
+        uint8_t* old_ctrl = ctrl;
+        size_ = deleted_ = 0;
+        capacity = new_capacity;
+        ctrl = reinterpret_cast<uint8_t*>(Alloc::alloc(capacity));
+        data = reinterpret_cast<Slot*>(Alloc::alloc(sizeof(Slot) * capacity));
+        std::memset(ctrl, EMPTY, capacity);
+        for(uint64_t i = 0; i < old_capacity; i++) {
+            if(!(old_ctrl[i] & 0x80)) {
+                insert(std::move(old_data[i].key), std::move(old_data[i].value));
+                old_data[i].~Slot();
+            }
+        }
+        Alloc::free(old_ctrl, old_capacity);
+        Alloc::free(old_data, sizeof(Slot) * old_capacity);
+    }
+
+    void clear() {
+        destroy();
+        size_ = deleted_ = 0;
+        std::memset(ctrl, EMPTY, capacity);
+    }
+
+    uint64_t index_for(const K& key) {
+        uint64_t hash = Hash{}(key);
+        return hash;
+    }
+    uint64_t prefetch(const K& key) {
+        uint64_t hash = Hash{}(key);
+        uint64_t group = h1(hash) & (capacity - 1) & ~(GROUP - 1);
+        ::prefetch(&ctrl[group]);
+        ::prefetch(&data[group]);
+        return hash;
+    }
+    V find_indexed(const K& key, uint64_t hash, uint64_t* steps) {
+        uint64_t group = h1(hash) & (capacity - 1) & ~(GROUP - 1);
+        for(;;) {
+            uint32_t mask = match(group, h2(hash));
+            while(mask) {
+                uint64_t index = group + __ctz(mask);
+                if(Eq{}(data[index].key, key)) return data[index].value;
+                mask &= mask - 1;
+            }
+            (*steps)++;
+            group = (group + GROUP) & (capacity - 1);
+        }
+    }
+
+    // assumes every key is in the map
+    void find_batch(const K* keys, size_t n, V* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const K* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    uint64_t size() { return size_; }
+
+    uint64_t memory_usage() { return (sizeof(Slot) + 1) * capacity + sizeof(Swiss); }
+
+    uint64_t sum_all_values() {
+        uint64_t sum = 0;
+        for(uint64_t group = 0; group < capacity; group += GROUP) {
+            uint32_t full = ~match_free(group);
+            while(full) {
+                sum += data[group + __ctz(full)].value;
+                full &= full - 1;
+            }
+        }
+        return sum;
+    }
+
+    struct Slot {
+        K key;
+        V value;
+    };
+    uint8_t* ctrl;
+    Slot* data;
+    uint64_t capacity;
+    uint64_t size_;
+    uint64_t deleted_;
+    double min_load;
+};
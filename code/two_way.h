@@ -2,22 +2,30 @@
 
 #include "base.h"
 
-template<uint64_t BUCKET>
+template<uint64_t BUCKET, typename Hash = Squirrel3_Hash>
 struct Two_Way {
 
     static constexpr uint64_t EMPTY = UINT64_MAX;
+    // grows when both of a key's buckets are full rather than at a load factor, so reserve(),
+    // shrink_to_fit() and the low-water mark go by this load instead. The fullest bucket
+    // decides when that happens, so big tables of small buckets can still grow below it.
+    static constexpr double FIT = 0.5;
+    // prefetch() touches four lines per key
+    static constexpr uint64_t BATCH = 4;
 
     Two_Way() {
         size_ = 0;
         capacity = 8;
+        min_load = FIT * SHRINK_LOAD;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
     }
+    explicit Two_Way(uint64_t n) : Two_Way() { reserve(n); }
     ~Two_Way() { __aligned_free(data); }
 
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
         Slot* slot_1 = &data[index_1];
@@ -42,7 +50,7 @@ struct Two_Way {
     }
 
     uint64_t find(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
         Slot* slot_1 = &data[index_1];
@@ -56,7 +64,7 @@ struct Two_Way {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
         Slot* slot_1 = &data[index_1];
@@ -72,7 +80,7 @@ struct Two_Way {
     }
 
     void erase(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
         Slot* slot_1 = &data[index_1];
@@ -85,6 +93,7 @@ struct Two_Way {
                 }
                 slot_1->keys[BUCKET - 1] = EMPTY;
                 size_--;
+                if(size_ < capacity * BUCKET * min_load && capacity > 8) resize(capacity / 2);
                 return;
             }
             if(slot_2->keys[i] == key) {
@@ -94,16 +103,29 @@ struct Two_Way {
                 }
                 slot_2->keys[BUCKET - 1] = EMPTY;
                 size_--;
+                if(size_ < capacity * BUCKET * min_load && capacity > 8) resize(capacity / 2);
                 return;
             }
         }
     }
 
-    void grow() {
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, BUCKET * FIT);
+        if(fit < capacity) resize(fit);
+    }
+
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, BUCKET * FIT);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot* old_data = data;
         size_ = 0;
-        capacity *= 2;
+        capacity = new_capacity;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
         for(uint64_t i = 0; i < old_capacity; i++) {
@@ -121,11 +143,11 @@ struct Two_Way {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         return hash;
     }
     uint64_t prefetch(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
         ::prefetch(data[index_1].keys);
@@ -147,6 +169,43 @@ struct Two_Way {
         }
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // one lookup for find_amac(): the first step scans the first bucket, and only if the key
+    // isn't there is the second one fetched
+    struct Probe {
+        uint64_t key, hash, value;
+        bool second;
+    };
+    void probe_start(Probe& p, uint64_t key) {
+        p.key = key;
+        p.hash = Hash{}(key);
+        p.second = false;
+        uint64_t index_1 = p.hash & (capacity - 1);
+        ::prefetch(data[index_1].keys);
+        ::prefetch(data[index_1].values);
+    }
+    bool probe_step(Probe& p) {
+        uint64_t index = (p.second ? p.hash >> 32 : p.hash) & (capacity - 1);
+        for(uint64_t i = 0; i < BUCKET; i++) {
+            if(data[index].keys[i] == p.key) {
+                p.value = data[index].values[i];
+                return true;
+            }
+        }
+        p.second = true;
+        uint64_t index_2 = (p.hash >> 32) & (capacity - 1);
+        ::prefetch(data[index_2].keys);
+        ::prefetch(data[index_2].values);
+        return false;
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Two_Way); }
@@ -169,4 +228,5 @@ struct Two_Way {
     Slot* data;
     uint64_t capacity;
     uint64_t size_;
+    double min_load;
 };
\ No newline at end of file
@@ -1,10 +1,10 @@
 #pragma once
 
 #include "base.h"
+#include "snapshot.h"
 
 #if defined(__clang__) || (not defined(_MSC_VER) && defined(__GNUC__))
 #include <immintrin.h>
-inline int __ctz(int32_t x) { return __builtin_ctz(x); }
 inline uint64_t __extract(__m256i& vec, int index) {
     switch(index) {
     case 0: return _mm256_extract_epi64(vec, 0);
@@ -26,32 +26,36 @@ inline void __insert(__m256i& vec, uint64_t value, int index) {
 }
 #else
 #include <intrin.h>
-int __ctz(int32_t x) {
-    unsigned long index;
-    _BitScanForward(&index, x);
-    return index;
-}
 inline uint64_t __extract(__m256i& vec, int index) { return vec.m256i_u64[index]; }
 inline void __insert(__m256i& vec, uint64_t value, int index) { vec.m256i_u64[index] = value; }
 #endif
 
+template<typename Hash = Squirrel3_Hash>
 struct Two_Way_SIMD {
 
     static constexpr int BUCKET = 4;
     static constexpr uint64_t EMPTY = UINT64_MAX;
+    // see Two_Way
+    static constexpr double FIT = 0.5;
     static inline const __m256i EMPTY256 = _mm256_set1_epi64x(EMPTY);
+    // prefetch() touches four lines per key
+    static constexpr uint64_t BATCH = 4;
 
     Two_Way_SIMD() {
         size_ = 0;
         capacity = 8;
+        min_load = FIT * SHRINK_LOAD;
+        mapped = nullptr;
+        mapped_bytes = 0;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
     }
-    ~Two_Way_SIMD() { __aligned_free(data); }
+    explicit Two_Way_SIMD(uint64_t n) : Two_Way_SIMD() { reserve(n); }
+    ~Two_Way_SIMD() { release(data, capacity); }
 
     // assumes key is not in the map
     void insert(uint64_t key, uint64_t value) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
         Slot* slot_1 = &data[index_1];
@@ -79,7 +83,7 @@ struct Two_Way_SIMD {
 
     uint64_t find(uint64_t key, uint64_t* steps) {
         __m256i key256 = _mm256_set1_epi64x(key);
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         Slot* slot_1 = &data[index_1];
         __m256i cmp_1 = _mm256_cmpeq_epi64(slot_1->keys, key256);
@@ -98,7 +102,7 @@ struct Two_Way_SIMD {
     }
 
     bool contains(uint64_t key, uint64_t* steps) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         Slot* slot_1 = &data[index_1];
         __m256i key256 = _mm256_set1_epi64x(key);
@@ -116,7 +120,7 @@ struct Two_Way_SIMD {
 
     void erase(uint64_t key) {
         __m256i key256 = _mm256_set1_epi64x(key);
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         Slot* slot_1 = &data[index_1];
         __m256i cmp_1 = _mm256_cmpeq_epi64(slot_1->keys, key256);
@@ -129,6 +133,7 @@ struct Two_Way_SIMD {
             }
             __insert(slot_1->keys, EMPTY, BUCKET - 1);
             size_--;
+            if(size_ < capacity * BUCKET * min_load && capacity > 8) resize(capacity / 2);
             return;
         }
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
@@ -142,13 +147,26 @@ struct Two_Way_SIMD {
         }
         __insert(slot_2->keys, EMPTY, BUCKET - 1);
         size_--;
+        if(size_ < capacity * BUCKET * min_load && capacity > 8) resize(capacity / 2);
+    }
+
+    void grow() { resize(capacity * 2); }
+
+    void shrink_to_fit() {
+        uint64_t fit = capacity_for(size_, BUCKET * FIT);
+        if(fit < capacity) resize(fit);
     }
 
-    void grow() {
+    void reserve(uint64_t n) {
+        uint64_t want = capacity_for(n, BUCKET * FIT);
+        if(want > capacity) resize(want);
+    }
+
+    void resize(uint64_t new_capacity) {
         uint64_t old_capacity = capacity;
         Slot* old_data = data;
         size_ = 0;
-        capacity *= 2;
+        capacity = new_capacity;
         data = reinterpret_cast<Slot*>(__aligned_alloc(CACHE_LINE, sizeof(Slot) * capacity));
         std::memset(data, 0xff, sizeof(Slot) * capacity);
         for(uint64_t i = 0; i < old_capacity; i++) {
@@ -161,7 +179,7 @@ struct Two_Way_SIMD {
                     break;
             }
         }
-        __aligned_free(old_data);
+        release(old_data, old_capacity);
     }
 
     void clear() {
@@ -170,11 +188,11 @@ struct Two_Way_SIMD {
     }
 
     uint64_t index_for(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         return hash;
     }
     uint64_t prefetch(uint64_t key) {
-        uint64_t hash = squirrel3(key);
+        uint64_t hash = Hash{}(key);
         uint64_t index_1 = hash & (capacity - 1);
         uint64_t index_2 = (hash >> 32) & (capacity - 1);
         ::prefetch(&data[index_1].keys);
@@ -202,6 +220,38 @@ struct Two_Way_SIMD {
         return __extract(slot_2->values, i);
     }
 
+    // assumes every key is in the map
+    void find_batch(const uint64_t* keys, size_t n, uint64_t* out) {
+        ::find_batch<BATCH>(*this, keys, n, out);
+    }
+    void contains_batch(const uint64_t* keys, size_t n, bool* out) {
+        ::contains_batch<BATCH>(*this, keys, n, out);
+    }
+
+    // see snapshot.h; a loaded table reads from the mapping until it next grows
+    bool save(const char* path) {
+        const void* arrays[] = {data};
+        return Snapshot::save<Hash>(path, "two_way_simd", capacity, size_, 0, arrays,
+                                    {sizeof(Slot)});
+    }
+    bool load_mmap(const char* path) {
+        Snapshot::Header header;
+        uint64_t length = 0;
+        void* base = Snapshot::map<Hash>(path, "two_way_simd", {sizeof(Slot)}, header, length);
+        if(!base) return false;
+        release(data, capacity);
+        mapped = base;
+        mapped_bytes = length;
+        data = Snapshot::array<Slot>(base, header, 0);
+        capacity = header.capacity;
+        size_ = header.size;
+        return true;
+    }
+    void release(void* old_data, uint64_t old_capacity) {
+        Snapshot::release<Aligned_Alloc>(mapped, mapped_bytes, old_data,
+                                         sizeof(Slot) * old_capacity);
+    }
+
     uint64_t size() { return size_; }
 
     uint64_t memory_usage() { return sizeof(Slot) * capacity + sizeof(Two_Way_SIMD); }
@@ -228,4 +278,8 @@ struct Two_Way_SIMD {
     Slot* data;
     uint64_t capacity;
     uint64_t size_;
+    // the snapshot the arrays live in, if loaded with load_mmap()
+    void* mapped;
+    uint64_t mapped_bytes;
+    double min_load;
 };